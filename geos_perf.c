@@ -1,9 +1,15 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
 #include <string.h>
-#include <sys/time.h>
+#include <getopt.h>
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sched.h>
 #include <sys/resource.h>
+#include <sys/wait.h>
 
 #include "geos_perf.h"
 
@@ -17,13 +23,32 @@ gp_test config_buffer_watersheds(void);
 gp_test config_buffer_australia(void);
 gp_test config_intersection(void);
 gp_test config_point_in_polygon(void);
+gp_test config_prepare(void);
+gp_test config_prepared_query(void);
+gp_test config_join(void);
+gp_test config_join_partitioned(void);
 gp_test config_tree_points(void);
 gp_test config_tree_points_nn(void);
+gp_test config_tree_build(void);
+gp_test config_tree_query(void);
+gp_test config_tree_churn(void);
+gp_test config_nearest_watershed(void);
+gp_test config_knn_watershed(void);
+gp_test config_distance_watershed(void);
 gp_test config_union_watersheds(void);
 gp_test config_isvalid_australia(void);
 gp_test config_valid_watersheds(void);
 gp_test config_isvalid_landcover(void);
 gp_test config_delaunay(void);
+gp_test config_synthetic_isvalid(void);
+gp_test config_wkt_read(void);
+gp_test config_wkt_write(void);
+gp_test config_wkb_read(void);
+gp_test config_wkb_write(void);
+gp_test config_geojson_read(void);
+gp_test config_geojson_write(void);
+gp_test config_coords_build(void);
+gp_test config_coords_extract(void);
 
 /*
 * And then add the function name here
@@ -36,11 +61,30 @@ static gp_config_func gp_config_funcs[] =
     config_union_watersheds,
     config_tree_points,
     config_tree_points_nn,
+    config_tree_build,
+    config_tree_query,
+    config_tree_churn,
+    config_nearest_watershed,
+    config_knn_watershed,
+    config_distance_watershed,
     config_point_in_polygon,
+    config_prepare,
+    config_prepared_query,
+    config_join,
+    config_join_partitioned,
     config_isvalid_australia,
     config_valid_watersheds,
     config_isvalid_landcover,
     config_delaunay,
+    config_synthetic_isvalid,
+    config_wkt_read,
+    config_wkt_write,
+    config_wkb_read,
+    config_wkb_write,
+    config_geojson_read,
+    config_geojson_write,
+    config_coords_build,
+    config_coords_extract,
     NULL
 };
 
@@ -72,6 +116,20 @@ geomlist_free(GEOSGeometryList* gl)
     return;
 }
 
+void
+geomlist_free_r(GEOSContextHandle_t ctx, GEOSGeometryList* gl)
+{
+    size_t i;
+    for (i = 0; i < gl->ngeoms; i++)
+    {
+        if (gl->geoms[i])
+            GEOSGeom_destroy_r(ctx, gl->geoms[i]);
+    }
+    free(gl->geoms);
+    gl->geoms = NULL;
+    return;
+}
+
 void
 geomlist_release(GEOSGeometryList* gl)
 {
@@ -104,19 +162,46 @@ geomlist_pop(GEOSGeometryList* gl)
 }
 
 size_t
-geomlist_size(GEOSGeometryList* gl)
+geomlist_size(const GEOSGeometryList* gl)
 {
     return gl->ngeoms;
 }
 
 const GEOSGeometry*
-geomlist_get(GEOSGeometryList* gl, size_t i)
+geomlist_get(const GEOSGeometryList* gl, size_t i)
 {
     if (i > gl->ngeoms-1)
         return NULL;
     return gl->geoms[i];
 }
 
+/*
+* Bounds of every geometry in the list together, for tests that
+* spread random probes over a dataset. geom_extent_r wants a
+* handle, so this takes one of its own.
+*/
+int
+geomlist_extent(const GEOSGeometryList* gl, double* xmin, double* ymin, double* xmax, double* ymax)
+{
+    size_t i;
+    int found = 0;
+    GEOSContextHandle_t ctx = GEOS_init_r();
+    *xmin = *ymin = *xmax = *ymax = 0.0;
+    for (i = 0; i < geomlist_size(gl); i++)
+    {
+        double gxmin, gymin, gxmax, gymax;
+        if (!geom_extent_r(ctx, geomlist_get(gl, i), &gxmin, &gymin, &gxmax, &gymax))
+            continue;
+        if (!found || gxmin < *xmin) *xmin = gxmin;
+        if (!found || gymin < *ymin) *ymin = gymin;
+        if (!found || gxmax > *xmax) *xmax = gxmax;
+        if (!found || gymax > *ymax) *ymax = gymax;
+        found = 1;
+    }
+    GEOS_finish_r(ctx);
+    return found;
+}
+
 void
 geomlist_print(GEOSGeometryList* gl)
 {
@@ -137,14 +222,54 @@ geomlist_print(GEOSGeometryList* gl)
 }
 
 
+/************************************************************************
+* Utilities for test parameters.
+*/
+
+const char*
+param_get(const gp_param* params, const char* name)
+{
+    const gp_param* param;
+    for (param = params; param && param->name; param++)
+    {
+        if (strcmp(param->name, name) == 0)
+            return param->value ? param->value : param->default_value;
+    }
+    return NULL;
+}
+
+double
+param_double(const gp_param* params, const char* name)
+{
+    const char* value = param_get(params, name);
+    return value ? strtod(value, NULL) : 0.0;
+}
+
+size_t
+param_node_capacity(const gp_param* params)
+{
+    double capacity = param_double(params, "node_capacity");
+    if (capacity < 2)
+    {
+        skip_report("node_capacity must be at least 2, not %s",
+            param_get(params, "node_capacity"));
+        return 0;
+    }
+    return (size_t)capacity;
+}
+
+
 /************************************************************************
 * Utility functions to polyfill old GEOS versions
 */
 
-/* GEOS < 3.7 does not have GEOSGeom_createPointFromXY */
+/* GEOS < 3.8 does not have GEOSGeom_createPointFromXY */
 GEOSGeometry *
 createPointFromXY(double x, double y)
 {
+#if GEOS_VERSION_CMP >= 308
+    return GEOSGeom_createPointFromXY(x, y);
+#else
     GEOSCoordSequence* cs = GEOSCoordSeq_create(
         1,  /* size */
         2); /* dims */
@@ -153,35 +278,123 @@ createPointFromXY(double x, double y)
     GEOSCoordSeq_setY(cs, 0, y);
 
     return GEOSGeom_createPoint(cs);
+#endif
+}
+
+/* GEOS < 3.11 does not have GEOSGeom_createRectangle */
+GEOSGeometry *
+createRectangle(double xmin, double ymin, double xmax, double ymax)
+{
+#if GEOS_VERSION_CMP >= 311
+    return GEOSGeom_createRectangle(xmin, ymin, xmax, ymax);
+#else
+    GEOSCoordSequence* cs = GEOSCoordSeq_create(5, 2);
+    GEOSCoordSeq_setX(cs, 0, xmin); GEOSCoordSeq_setY(cs, 0, ymin);
+    GEOSCoordSeq_setX(cs, 1, xmax); GEOSCoordSeq_setY(cs, 1, ymin);
+    GEOSCoordSeq_setX(cs, 2, xmax); GEOSCoordSeq_setY(cs, 2, ymax);
+    GEOSCoordSeq_setX(cs, 3, xmin); GEOSCoordSeq_setY(cs, 3, ymax);
+    GEOSCoordSeq_setX(cs, 4, xmin); GEOSCoordSeq_setY(cs, 4, ymin);
+    return GEOSGeom_createPolygon(GEOSGeom_createLinearRing(cs), NULL, 0);
+#endif
+}
+
+/*
+* GEOS < 3.7 does not have GEOSGeom_getXMin and friends, so the
+* extent comes from the corners of the envelope, a polygon, or a
+* point when the geometry is one.
+*/
+int
+geom_extent_r(GEOSContextHandle_t ctx, const GEOSGeometry* g,
+              double* xmin, double* ymin, double* xmax, double* ymax)
+{
+#if GEOS_VERSION_CMP >= 311
+    return GEOSGeom_getExtent_r(ctx, g, xmin, ymin, xmax, ymax) != 0;
+#elif GEOS_VERSION_CMP >= 307
+    return GEOSGeom_getXMin_r(ctx, g, xmin) && GEOSGeom_getYMin_r(ctx, g, ymin) &&
+           GEOSGeom_getXMax_r(ctx, g, xmax) && GEOSGeom_getYMax_r(ctx, g, ymax);
+#else
+    unsigned int i, size = 0;
+    const GEOSCoordSequence* cs;
+    GEOSGeometry* envelope;
+    if (GEOSisEmpty_r(ctx, g) || !(envelope = GEOSEnvelope_r(ctx, g)))
+        return 0;
+    cs = GEOSGeom_getCoordSeq_r(ctx,
+        GEOSGeomTypeId_r(ctx, envelope) == GEOS_POLYGON ?
+        GEOSGetExteriorRing_r(ctx, envelope) : envelope);
+    if (cs)
+        GEOSCoordSeq_getSize_r(ctx, cs, &size);
+    for (i = 0; i < size; i++)
+    {
+        double x, y;
+        GEOSCoordSeq_getX_r(ctx, cs, i, &x);
+        GEOSCoordSeq_getY_r(ctx, cs, i, &y);
+        if (i == 0 || x < *xmin) *xmin = x;
+        if (i == 0 || y < *ymin) *ymin = y;
+        if (i == 0 || x > *xmax) *xmax = x;
+        if (i == 0 || y > *ymax) *ymax = y;
+    }
+    GEOSGeom_destroy_r(ctx, envelope);
+    return size > 0;
+#endif
 }
 
 
+/************************************************************************
+* Runner options, set from the command line.
+*/
+
+static struct {
+    uint32_t warmup;   /* untimed iterations before timing starts */
+    double budget;     /* adaptive: seconds of run time per test */
+    double ci_width;   /* adaptive: target relative width of median 95% CI */
+    uint32_t threads;  /* throughput mode: run on 1..threads threads */
+    int memory;        /* track allocations during the run phase */
+    int isolate;       /* run each test in a forked child process */
+    int cpu;           /* core to pin test execution to, or -1 */
+} options = {
+    1,
+    0.0,
+    0.0,
+    0,
+    0,
+    0,
+    -1
+};
+
+
 /************************************************************************
 * Utility functions for the testing process.
 */
 
-static struct timeval
-time_now()
+double
+seconds_now(void)
 {
-    struct timeval t;
-    struct timezone tzp;
-    gettimeofday(&t, &tzp);
-    return t;
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (double)t.tv_sec + (double)t.tv_nsec / 1000000000.0;
 }
 
-static double
-time_difference(struct timeval start, struct timeval end)
+/*
+* Cost of the pair of clock reads that brackets every
+* iteration, subtracted from each run sample.
+*/
+static double timer_overhead = 0.0;
+
+#define TIMER_CALIBRATION_COUNT 1001
+
+static void
+timer_calibrate(void)
 {
-    int64_t diff_us = (int64_t)(end.tv_usec - start.tv_usec);
-    if (start.tv_sec == end.tv_sec)
-    {
-        return (double)diff_us / 1000000.0;
-    }
-    else
+    size_t i;
+    double samples[TIMER_CALIBRATION_COUNT];
+    for (i = 0; i < TIMER_CALIBRATION_COUNT; i++)
     {
-        int64_t diff_s = (int64_t)(end.tv_sec - start.tv_sec);
-        return (double)(diff_s) + (double)(diff_us) / 1000000.0;;
+        double start = seconds_now();
+        double end = seconds_now();
+        samples[i] = end - start;
     }
+    stats_sort(samples, TIMER_CALIBRATION_COUNT);
+    timer_overhead = stats_percentile(samples, TIMER_CALIBRATION_COUNT, 50.0);
 }
 
 static void
@@ -216,92 +429,974 @@ debug_stderr(uint32_t level, const char* fmt, ...)
 }
 
 static void
-result_to_csv(const gp_result* result)
+result_free(gp_result* result)
+{
+    free(result->samples);
+    result->samples = NULL;
+}
+
+/*
+* Work done by one run iteration, as reported by the test.
+*/
+static uint64_t work_items = 0;
+static uint64_t work_bytes = 0;
+
+void
+work_report(uint64_t items, uint64_t bytes)
+{
+    work_items = items;
+    work_bytes = bytes;
+}
+
+/*
+* Lines of extra measurements reported by the test,
+* logged after its run.
+*/
+static char notes[4 * MAXSTRLEN];
+static size_t notes_len = 0;
+
+void
+note_report(const char* fmt, ...)
+{
+    va_list ap;
+    int len;
+    size_t room = sizeof(notes) - notes_len;
+    if (room < 2)
+        return;
+    /* Leave room for the newline */
+    va_start(ap, fmt);
+    len = vsnprintf(notes + notes_len, room - 1, fmt, ap);
+    va_end(ap);
+    if (len < 0)
+        return;
+    notes_len += (size_t)len < room - 2 ? (size_t)len : room - 2;
+    notes[notes_len++] = '\n';
+    notes[notes_len] = '\0';
+}
+
+/*
+* Set while the warmup iterations run.
+*/
+static int warmup_active = 0;
+
+int
+warmup_running(void)
+{
+    return warmup_active;
+}
+
+/*
+* Why the test skipped itself in setup, empty if it did not.
+*/
+static char skip_reason[MAXSTRLEN];
+
+void
+skip_report(const char* fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(skip_reason, sizeof(skip_reason), fmt, ap);
+    va_end(ap);
+}
+
+static void
+notes_log(const char* name)
+{
+    char* line = notes;
+    char* end;
+    while ((end = strchr(line, '\n')) != NULL)
+    {
+        *end = '\0';
+        log_stderr(" NOTE [%s] %s\n", name, line);
+        line = end + 1;
+    }
+    notes_len = 0;
+    notes[0] = '\0';
+}
+
+/*
+* The data files a test reads: its listed files, and the
+* value of its "data" parameter if it has one.
+*/
+#define MAX_TEST_DATA 16
+
+static size_t
+test_data_files(const gp_test* test, const char** files, size_t max)
+{
+    size_t n = 0;
+    const char* const* file;
+    const char* param = param_get(test->params, "data");
+    for (file = test->data_files; file && *file && n < max; file++)
+        files[n++] = *file;
+    if (param && n < max)
+        files[n++] = param;
+    return n;
+}
+
+/* First data file of a test that is missing, or NULL */
+static const char*
+test_data_missing(const gp_test* test)
+{
+    size_t i, n;
+    const char* files[MAX_TEST_DATA];
+    n = test_data_files(test, files, MAX_TEST_DATA);
+    for (i = 0; i < n; i++)
+    {
+        if (data_check(files[i]) == GP_DATA_MISSING)
+            return files[i];
+    }
+    return NULL;
+}
+
+/* Total feature and vertex counts of the data files of a test */
+static void
+test_data_counts(const gp_test* test, uint64_t* features, uint64_t* vertices)
+{
+    size_t i, n;
+    const char* files[MAX_TEST_DATA];
+    *features = *vertices = 0;
+    n = test_data_files(test, files, MAX_TEST_DATA);
+    for (i = 0; i < n; i++)
+    {
+        uint64_t f, v;
+        if (data_counts(files[i], &f, &v))
+        {
+            *features += f;
+            *vertices += v;
+        }
+    }
+}
+
+/*
+* In adaptive mode the median confidence interval is only
+* re-evaluated when the sample count has grown by this
+* fraction, so that sorting does not dominate short tests.
+*/
+#define ADAPTIVE_CHECK_GROWTH 0.1
+
+static int
+run_is_precise(const double* samples, size_t nsamples, double ci_width)
 {
-    fprintf(stdout, "%s,%s,%u,%0.5g,%0.5g,%0.5g\n",
-        result->version,
-        result->name,
-        result->count,
-        result->setup_time,
-        result->run_time,
-        result->cleanup_time);
+    int ok;
+    double lo, hi, median;
+    double* sorted = malloc(sizeof(double) * nsamples);
+    memcpy(sorted, samples, sizeof(double) * nsamples);
+    stats_sort(sorted, nsamples);
+    median = stats_percentile(sorted, nsamples, 50.0);
+    ok = stats_median_ci(sorted, nsamples, &lo, &hi) &&
+         median > 0.0 &&
+         (hi - lo) / median <= ci_width;
+    free(sorted);
+    return ok;
 }
 
 static gp_result
 run_test(const gp_test* test)
 {
     size_t i;
-    gp_result result;
+    gp_result result = {0};
     double run_time = 0.0,
            setup_time = 0.0,
            cleanup_time = 0.0;
-    struct timeval start, end;
+    int adaptive = options.budget > 0.0 || options.ci_width > 0.0;
+    uint32_t count_max = adaptive && test->count_max > test->count_min ?
+                         test->count_max : test->count_min;
+    size_t next_check = test->count_min;
+    double* samples = malloc(sizeof(double) * (count_max ? count_max : 1));
+    int track = options.memory && alloc_tracking_available();
+    long rss;
+    double start, end;
 
     /* Prepare to run tests */
     log_stderr("SETUP [%s] ...", test->name);
-    start = time_now();
+    load_stats_reset();
+    work_report(0, 0);
+    notes_len = 0;
+    notes[0] = '\0';
+    skip_reason[0] = '\0';
+    rss = peak_rss();
+    counters_start();
+    start = seconds_now();
     if (test->func_setup)
         test->func_setup();
-    end = time_now();
-    setup_time = time_difference(start, end);
+    end = seconds_now();
+    counters_stop(&result.counters[GP_PHASE_SETUP]);
+    result.rss_delta[GP_PHASE_SETUP] = peak_rss() - rss;
+    setup_time = end - start;
     log_stderr(" %0.3gs\n", setup_time);
+    if (skip_reason[0])
+    {
+        log_stderr(" SKIP [%s] %s\n", test->name, skip_reason);
+        result.skipped = 1;
+        result.count = 0;
+        result.samples = samples;
+        return result;
+    }
+    result.skipped = 0;
+    load_stats_read(&result.load);
+    if (result.load.files > 0)
+        log_stderr(" LOAD [%s] %llu geometries, wkt %0.3gs, wkb cache %0.3gs (%u of %u files cached, %u threads)\n",
+            test->name, (unsigned long long)result.load.geoms,
+            result.load.wkt_time, result.load.cache_time,
+            result.load.cache_hits, result.load.files, result.load.threads);
+    test_data_counts(test, &result.features, &result.vertices);
+    if (result.features > 0)
+        log_stderr(" DATA [%s] %llu features, %llu vertices\n", test->name,
+            (unsigned long long)result.features, (unsigned long long)result.vertices);
+
+    /* Untimed iterations to warm caches and lazy structures */
+    if (options.warmup > 0 && test->func_run)
+    {
+        log_stderr(" WARM [%s] ...", test->name);
+        warmup_active = 1;
+        start = seconds_now();
+        for (i = 0; i < options.warmup; i++)
+            test->func_run();
+        end = seconds_now();
+        warmup_active = 0;
+        log_stderr(" %0.3gs\n", end - start);
+    }
 
     /* Run the tests and time them */
     log_stderr("  RUN [%s] ...", test->name);
-    for (i = 0; i < test->count; i++)
+    alloc_tracking_reset();
+    rss = peak_rss();
+    counters_start();
+    for (i = 0; i < count_max; i++)
     {
-        start = time_now();
+        double sample;
+
+        /* Adaptive stop once the minimum is done */
+        if (adaptive && i >= test->count_min)
+        {
+            if (options.budget > 0.0 && run_time >= options.budget)
+                break;
+            if (options.ci_width > 0.0 && i >= next_check)
+            {
+                if (run_is_precise(samples, i, options.ci_width))
+                    break;
+                next_check = i + 1 + (size_t)(i * ADAPTIVE_CHECK_GROWTH);
+            }
+        }
+
+        if (track)
+            alloc_tracking_start();
+        start = seconds_now();
         if (test->func_run)
             test->func_run();
-        end = time_now();
-        run_time += time_difference(start, end);
+        end = seconds_now();
+        if (track)
+            alloc_tracking_stop();
+        sample = end - start - timer_overhead;
+        samples[i] = sample > 0.0 ? sample : 0.0;
+        run_time += samples[i];
     }
-    log_stderr(" %0.3gs\n", run_time);
+    counters_stop(&result.counters[GP_PHASE_RUN]);
+    result.rss_delta[GP_PHASE_RUN] = peak_rss() - rss;
+    result.allocs_valid = track;
+    alloc_tracking_read(&result.allocs);
+    log_stderr(" %0.3gs (%zu iterations)\n", run_time, i);
+    result.work_items = work_items;
+    result.work_bytes = work_bytes;
 
     /* Clean up after the tests */
     log_stderr("CLEAN [%s] ...", test->name);
-    start = time_now();
+    rss = peak_rss();
+    counters_start();
+    start = seconds_now();
     if (test->func_cleanup)
         test->func_cleanup();
-    end = time_now();
-    cleanup_time = time_difference(start, end);
+    end = seconds_now();
+    counters_stop(&result.counters[GP_PHASE_CLEANUP]);
+    result.rss_delta[GP_PHASE_CLEANUP] = peak_rss() - rss;
+    cleanup_time = end - start;
     log_stderr(" %0.3gs\n", cleanup_time);
 
     /* Sumarize the results */
     result.version = GEOSversion();
-    result.count = test->count;
+    result.warmup = test->func_run ? options.warmup : 0;
+    result.count = (uint32_t)i;
     result.setup_time = setup_time;
     result.run_time = run_time;
     result.cleanup_time = cleanup_time;
     result.name = test->name;
+    result.params = NULL;
+    result.samples = samples;
+    stats_compute(samples, result.count, &result.stats);
+    if (result.work_items > 0 && result.stats.p50 > 0.0)
+        log_stderr(" WORK [%s] %0.4g items/s, %0.4g MB/s\n", test->name,
+            result.work_items / result.stats.p50,
+            result.work_bytes / result.stats.p50 / 1e6);
+    notes_log(test->name);
     return result;
 }
 
 
 
+/************************************************************************
+* Process isolation and CPU pinning.
+*
+* In isolation mode every test runs in a freshly forked child,
+* so heap state left by earlier tests cannot affect it. The child
+* sends its result back over a pipe: the gp_result struct itself,
+* followed by the samples array. The pointers in the struct are
+* meaningless in the parent and are fixed up after reading.
+*/
+
+static int
+pin_to_cpu(int cpu)
+{
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) != 0)
+    {
+        log_stderr("unable to pin to cpu %d: %s\n", cpu, strerror(errno));
+        return 0;
+    }
+    return 1;
+#else
+    log_stderr("cpu pinning is only supported on Linux\n");
+    return 0;
+#endif
+}
+
+static int
+write_all(int fd, const void* buf, size_t size)
+{
+    const char* p = buf;
+    while (size > 0)
+    {
+        ssize_t n = write(fd, p, size);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return 0;
+        p += n;
+        size -= (size_t)n;
+    }
+    return 1;
+}
+
+static int
+read_all(int fd, void* buf, size_t size)
+{
+    char* p = buf;
+    while (size > 0)
+    {
+        ssize_t n = read(fd, p, size);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return 0;
+        p += n;
+        size -= (size_t)n;
+    }
+    return 1;
+}
+
+static int
+result_write(int fd, const gp_result* result)
+{
+    return write_all(fd, result, sizeof(gp_result)) &&
+           write_all(fd, result->samples, sizeof(double) * result->count);
+}
+
+static int
+result_read(int fd, const gp_test* test, gp_result* result)
+{
+    if (!read_all(fd, result, sizeof(gp_result)))
+        return 0;
+    result->version = GEOSversion();
+    result->name = test->name;
+    result->params = NULL;
+    result->samples = malloc(sizeof(double) * (result->count ? result->count : 1));
+    if (!read_all(fd, result->samples, sizeof(double) * result->count))
+    {
+        result_free(result);
+        return 0;
+    }
+    return 1;
+}
+
+static int
+run_test_isolated(const gp_test* test, gp_result* result)
+{
+    int fds[2], status, ok;
+    pid_t pid;
+
+    if (pipe(fds) != 0)
+    {
+        log_stderr("unable to create pipe: %s\n", strerror(errno));
+        return 0;
+    }
+
+    /* Do not let the child inherit unwritten output */
+    fflush(stdout);
+    fflush(stderr);
+
+    pid = fork();
+    if (pid < 0)
+    {
+        log_stderr("unable to fork: %s\n", strerror(errno));
+        close(fds[0]);
+        close(fds[1]);
+        return 0;
+    }
+
+    if (pid == 0)
+    {
+        gp_result child_result;
+        close(fds[0]);
+        if (options.cpu >= 0)
+            pin_to_cpu(options.cpu);
+        /* Counters opened by the parent only count the parent */
+        counters_close();
+        counters_open();
+        child_result = run_test(test);
+        ok = result_write(fds[1], &child_result);
+        close(fds[1]);
+        fflush(stderr);
+        _exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    close(fds[1]);
+    ok = result_read(fds[0], test, result);
+    close(fds[0]);
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+        ;
+
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS)
+    {
+        log_stderr(" FAIL [%s] child process ", test->name);
+        if (WIFSIGNALED(status))
+            log_stderr("killed by signal %d\n", WTERMSIG(status));
+        else
+            log_stderr("exited with status %d\n", WEXITSTATUS(status));
+        if (ok)
+            result_free(result);
+        return 0;
+    }
+    return ok;
+}
+
+
+
+/************************************************************************
+* Parameter sweeps.
+*
+* A sweep is a parameter name and a list of values, given on the
+* command line as name=value,value,... Every test with a parameter
+* of that name is run once for each value, and a test with several
+* swept parameters is run for every combination of them.
+*
+* The "order" sweep is global: it sets the order data files are
+* loaded in, and every test is run once for each order.
+*/
+
+#define MAX_SWEEPS 16
+#define MAX_SWEEP_VALUES 64
+
+typedef struct {
+    char* name;
+    char* values[MAX_SWEEP_VALUES];
+    size_t nvalues;
+} gp_sweep;
+
+static gp_sweep sweeps[MAX_SWEEPS];
+static size_t nsweeps = 0;
+
+static int
+sweep_parse(const char* arg)
+{
+    char* value;
+    char* values;
+    gp_sweep* sweep;
+    char* name = strdup(arg);
+    char* equals = strchr(name, '=');
+
+    if (!equals || equals == name || nsweeps >= MAX_SWEEPS)
+    {
+        free(name);
+        return 0;
+    }
+    *equals = '\0';
+    values = equals + 1;
+
+    sweep = sweeps + nsweeps++;
+    sweep->name = name;
+    sweep->nvalues = 0;
+    while ((value = strsep(&values, ",")) != NULL)
+    {
+        if (*value && sweep->nvalues < MAX_SWEEP_VALUES)
+            sweep->values[sweep->nvalues++] = value;
+    }
+    return sweep->nvalues > 0;
+}
+
+static void
+sweep_free(void)
+{
+    size_t i;
+    for (i = 0; i < nsweeps; i++)
+        free(sweeps[i].name);
+    nsweeps = 0;
+}
+
+static const gp_sweep*
+sweep_find(const char* name)
+{
+    size_t i;
+    for (i = 0; i < nsweeps; i++)
+    {
+        if (strcmp(sweeps[i].name, name) == 0)
+            return sweeps + i;
+    }
+    return NULL;
+}
+
+/* Check the values of the global order sweep */
+static int
+sweep_check_order(void)
+{
+    size_t i;
+    const gp_sweep* sweep = sweep_find("order");
+    for (i = 0; sweep && i < sweep->nvalues; i++)
+    {
+        if (order_parse(sweep->values[i]) < 0)
+        {
+            fprintf(stderr, "unknown order '%s', use original, hilbert, morton or shuffle\n",
+                    sweep->values[i]);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int
+is_number(const char* str)
+{
+    char* end;
+    strtod(str, &end);
+    return end != str && *end == '\0';
+}
+
+/*
+* Check swept values against the tests that will run and take
+* them, all of them when names is empty: a parameter whose default
+* is a number must be swept over numbers, since the tests read it
+* with param_double, which reads "abc" as zero. Tests can share a
+* parameter name with different meanings, so only the named ones
+* count. A swept name no selected test takes is most likely a typo,
+* so it is rejected rather than silently swept over.
+*/
+static int
+sweep_check_numeric(char** names, int nnames)
+{
+    size_t i;
+    int used[MAX_SWEEPS] = {0};
+    gp_config_func* config_func;
+    for (config_func = gp_config_funcs; *config_func != NULL; config_func++)
+    {
+        const gp_param* param;
+        int n, found = nnames == 0;
+        gp_test test = (*config_func)();
+        if (test.count_max < 1)
+            continue;
+        for (n = 0; n < nnames && !found; n++)
+            found = strcmp(test.name, names[n]) == 0;
+        if (!found)
+            continue;
+        for (param = test.params; param && param->name; param++)
+        {
+            const gp_sweep* sweep = sweep_find(param->name);
+            if (sweep)
+                used[sweep - sweeps] = 1;
+            if (!sweep || !is_number(param->default_value))
+                continue;
+            for (i = 0; i < sweep->nvalues; i++)
+            {
+                if (!is_number(sweep->values[i]))
+                {
+                    fprintf(stderr, "parameter '%s' of '%s' is numeric, not '%s'\n",
+                            param->name, test.name, sweep->values[i]);
+                    return 0;
+                }
+            }
+        }
+    }
+    for (i = 0; i < nsweeps; i++)
+    {
+        if (!used[i] && strcmp(sweeps[i].name, "order") != 0)
+        {
+            fprintf(stderr, "unknown parameter '%s'\n", sweeps[i].name);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+* Set the parameters to combination number combo, treating
+* the combinations as a mixed-radix number with one digit per
+* parameter, and describe the values as name=value;name=value.
+* Returns zero once combo is past the last combination.
+*/
+static int
+params_set(gp_param* params, size_t combo, char* desc, size_t desclen)
+{
+    gp_param* param;
+    const gp_sweep* order_sweep = sweep_find("order");
+    desc[0] = '\0';
+    if (order_sweep)
+    {
+        const char* value = order_sweep->values[combo % order_sweep->nvalues];
+        order_set(value);
+        combo /= order_sweep->nvalues;
+        snprintf(desc, desclen, "order=%s", value);
+    }
+    for (param = params; param && param->name; param++)
+    {
+        const gp_sweep* sweep = sweep_find(param->name);
+        size_t nvalues = sweep ? sweep->nvalues : 1;
+        size_t len = strlen(desc);
+        param->value = sweep ? sweep->values[combo % nvalues] : param->default_value;
+        combo /= nvalues;
+        snprintf(desc + len, desclen - len, "%s%s=%s",
+                 len ? ";" : "", param->name, param->value);
+    }
+    return combo == 0;
+}
+
+
+
 /************************************************************************
 * Main testing loop
 */
 
 uint32_t debug_level = 0;
 
+static void
+usage(const char* prog)
+{
+    fprintf(stderr,
+        "Usage: %s [options] [test name ...]\n"
+        "\n"
+        "Runs all tests, or only the named tests.\n"
+        "\n"
+        "  -w, --warmup N       untimed warmup iterations per test (default %u)\n"
+        "  -b, --budget SECS    adaptive: keep iterating up to the test maximum\n"
+        "                       until SECS of run time are spent\n"
+        "  -c, --ci-width PCT   adaptive: keep iterating up to the test maximum\n"
+        "                       until the 95%% CI of the median is within PCT\n"
+        "                       percent of the median\n"
+        "  -m, --memory         track allocations made by each run iteration\n"
+        "  -i, --isolate        run each test in its own forked process\n"
+        "  -a, --affinity CPU   pin test execution to core CPU\n"
+        "  -l, --library PATH   A/B mode: load this libgeos_c build, give two or\n"
+        "                       more to compare them in one process\n"
+        "  -t, --threads N      throughput mode: run the tests that support it\n"
+        "                       on 1 to N threads, each with its own GEOS context\n"
+        "  --save-samples FILE  append every run sample to FILE, for use as\n"
+        "                       a baseline\n"
+        "  --baseline FILE      compare each test to its samples in FILE and\n"
+        "                       exit non-zero if any test regressed\n"
+        "  --threshold PCT      slowdown that counts as a regression, when it\n"
+        "                       is also significant (default 5)\n"
+        "  -p, --param NAME=V,V,...\n"
+        "                       sweep a test parameter over a list of values,\n"
+        "                       producing one result per combination\n"
+        "  --cache-dir DIR      keep the WKB cache of the data files in DIR\n"
+        "  --no-cache           always parse the WKT data files\n"
+        "  --load-threads N     parse data files on N threads (default 1)\n"
+        "  --data-dir DIR       look for data files in DIR before the source\n"
+        "                       tree, can be given more than once\n"
+        "  --write-manifest     write a manifest of the data files to stdout\n"
+        "  --order ORDER,...    run every test with its data files in each\n"
+        "                       order: original, hilbert, morton or shuffle\n"
+        "  --pipeline OP[:ARG]  pipeline mode: stream each data file named after\n"
+        "                       the options through OP (parse, isvalid, buffer,\n"
+        "                       simplify, convexhull) on --threads workers\n"
+        "  --queue-size N       lines held between the pipeline reader and\n"
+        "                       workers (default 1024)\n"
+        "  -f, --format FORMAT  output format, csv or json (default csv)\n"
+        "  -o, --output FILE    write results to FILE instead of stdout\n"
+        "  -d, --debug LEVEL    debug message level\n"
+        "  -h, --help           show this message\n",
+        prog, options.warmup);
+}
+
+#define MAX_LIBRARIES 8
+
+/* Options with no short form */
+enum {
+    OPT_SAVE_SAMPLES = 256,
+    OPT_BASELINE,
+    OPT_THRESHOLD,
+    OPT_CACHE_DIR,
+    OPT_NO_CACHE,
+    OPT_LOAD_THREADS,
+    OPT_PIPELINE,
+    OPT_QUEUE_SIZE,
+    OPT_ORDER,
+    OPT_DATA_DIR,
+    OPT_WRITE_MANIFEST
+};
+
 int
 main(int argc, char *argv[])
 {
+    int opt;
+    const char* libraries[MAX_LIBRARIES];
+    int nlibraries = 0;
+    const char* samples_file_name = NULL;
+    const char* baseline_file_name = NULL;
+    const char* format = "csv";
+    const char* output_file_name = NULL;
+    const char* pipeline_op = NULL;
+    size_t queue_size = 0;
+    int write_manifest = 0;
+    double threshold = 0.05;
+    FILE* samples_file = NULL;
+    int regressions = 0;
+    static const struct option long_options[] =
+    {
+        {"warmup",   required_argument, NULL, 'w'},
+        {"budget",   required_argument, NULL, 'b'},
+        {"ci-width", required_argument, NULL, 'c'},
+        {"memory",   no_argument,       NULL, 'm'},
+        {"isolate",  no_argument,       NULL, 'i'},
+        {"affinity", required_argument, NULL, 'a'},
+        {"library",  required_argument, NULL, 'l'},
+        {"threads",  required_argument, NULL, 't'},
+        {"save-samples", required_argument, NULL, OPT_SAVE_SAMPLES},
+        {"baseline", required_argument, NULL, OPT_BASELINE},
+        {"threshold", required_argument, NULL, OPT_THRESHOLD},
+        {"param",    required_argument, NULL, 'p'},
+        {"cache-dir", required_argument, NULL, OPT_CACHE_DIR},
+        {"no-cache", no_argument,       NULL, OPT_NO_CACHE},
+        {"load-threads", required_argument, NULL, OPT_LOAD_THREADS},
+        {"order",    required_argument, NULL, OPT_ORDER},
+        {"data-dir", required_argument, NULL, OPT_DATA_DIR},
+        {"write-manifest", no_argument, NULL, OPT_WRITE_MANIFEST},
+        {"pipeline", required_argument, NULL, OPT_PIPELINE},
+        {"queue-size", required_argument, NULL, OPT_QUEUE_SIZE},
+        {"format",   required_argument, NULL, 'f'},
+        {"output",   required_argument, NULL, 'o'},
+        {"debug",    required_argument, NULL, 'd'},
+        {"help",     no_argument,       NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+
+    while ((opt = getopt_long(argc, argv, "w:b:c:mia:l:t:p:f:o:d:h", long_options, NULL)) != -1)
+    {
+        switch (opt)
+        {
+            case 'w':
+                options.warmup = (uint32_t)strtoul(optarg, NULL, 10);
+                break;
+            case 'b':
+                options.budget = strtod(optarg, NULL);
+                break;
+            case 'c':
+                options.ci_width = strtod(optarg, NULL) / 100.0;
+                break;
+            case 'm':
+                options.memory = 1;
+                break;
+            case 'i':
+                options.isolate = 1;
+                break;
+            case 'a':
+                options.cpu = (int)strtol(optarg, NULL, 10);
+                break;
+            case 'l':
+                if (nlibraries < MAX_LIBRARIES)
+                    libraries[nlibraries++] = optarg;
+                break;
+            case 't':
+                options.threads = (uint32_t)strtoul(optarg, NULL, 10);
+                break;
+            case OPT_SAVE_SAMPLES:
+                samples_file_name = optarg;
+                break;
+            case OPT_BASELINE:
+                baseline_file_name = optarg;
+                break;
+            case OPT_THRESHOLD:
+                threshold = strtod(optarg, NULL) / 100.0;
+                break;
+            case 'p':
+                if (!sweep_parse(optarg))
+                {
+                    log_stderr("invalid parameter sweep '%s'\n", optarg);
+                    return 1;
+                }
+                break;
+            case OPT_CACHE_DIR:
+                cache_set_dir(optarg);
+                break;
+            case OPT_NO_CACHE:
+                cache_set_dir(NULL);
+                break;
+            case OPT_LOAD_THREADS:
+                load_threads_set((uint32_t)strtoul(optarg, NULL, 10));
+                break;
+            case OPT_ORDER:
+            {
+                char sweep[MAXSTRLEN];
+                snprintf(sweep, sizeof(sweep), "order=%s", optarg);
+                if (!sweep_parse(sweep))
+                {
+                    log_stderr("invalid order list '%s'\n", optarg);
+                    return 1;
+                }
+                break;
+            }
+            case OPT_DATA_DIR:
+                if (!data_dir_add(optarg))
+                {
+                    log_stderr("too many data directories\n");
+                    return 1;
+                }
+                break;
+            case OPT_WRITE_MANIFEST:
+                write_manifest = 1;
+                break;
+            case OPT_PIPELINE:
+                pipeline_op = optarg;
+                break;
+            case OPT_QUEUE_SIZE:
+                queue_size = (size_t)strtoul(optarg, NULL, 10);
+                break;
+            case 'f':
+                format = optarg;
+                break;
+            case 'o':
+                output_file_name = optarg;
+                break;
+            case 'd':
+                debug_level = (uint32_t)strtoul(optarg, NULL, 10);
+                break;
+            case 'h':
+                usage(argv[0]);
+                return 0;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (!sweep_check_order() || !sweep_check_numeric(argv + optind, argc - optind))
+        return 1;
+
+    /* A/B mode only uses the libraries named on the command line */
+    if (nlibraries > 0)
+    {
+        int i, ok = 1;
+        for (i = 0; i < nlibraries && ok; i++)
+            ok = ab_load(libraries[i]);
+        if (ok)
+            ok = output_open(format, output_file_name);
+        if (ok)
+        {
+            ok = ab_compare(options.warmup, argv + optind, argc - optind, output_ab);
+            output_close();
+        }
+        ab_unload();
+        return ok ? 0 : 1;
+    }
+
+    if (baseline_file_name && !baseline_load(baseline_file_name))
+        return 1;
+
+    if (samples_file_name)
+    {
+        samples_file = fopen(samples_file_name, "a");
+        if (!samples_file)
+        {
+            log_stderr("unable to open '%s' for writing\n", samples_file_name);
+            return 1;
+        }
+    }
+
     initGEOS(geos_log_stderr, geos_log_stderr);
 
+    if (write_manifest)
+    {
+        int ok = manifest_write(stdout);
+        data_free();
+        finishGEOS();
+        return ok ? 0 : 1;
+    }
+
+    if (!output_open(format, output_file_name))
+    {
+        finishGEOS();
+        return 1;
+    }
+
     log_stderr("VERSION [GEOS %s]\n", GEOSversion());
 
+    /* Pipeline mode streams data files instead of running tests */
+    if (pipeline_op)
+    {
+        int i, ok = 1;
+        static const char* default_files[] = {"watersheds.wkt.gz"};
+        const char** files = optind < argc ? (const char**)argv + optind : default_files;
+        int nfiles = optind < argc ? argc - optind : 1;
+        uint32_t nworkers = options.threads > 0 ? options.threads : 1;
+        for (i = 0; i < nfiles && ok; i++)
+        {
+            gp_pipeline_result result;
+            if (data_check(files[i]) == GP_DATA_MISSING)
+            {
+                log_stderr("SKIP [%s] data file not found\n", files[i]);
+                continue;
+            }
+            ok = run_pipeline(pipeline_op, files[i], nworkers, queue_size, &result);
+            if (!ok)
+                break;
+            log_stderr("PIPELINE [%s] %s, %u workers ... %0.3gs\n",
+                files[i], pipeline_op, result.workers, result.wall_time);
+            log_stderr(" WORK [%s] %0.4g features/s, %0.4g MB/s, peak RSS %ld kB (+%ld kB), queue peak %llu lines, %llu reader waits\n",
+                files[i], result.features_per_sec, result.mb_per_sec,
+                result.peak_rss, result.rss_delta,
+                (unsigned long long)result.peak_queue,
+                (unsigned long long)result.reader_waits);
+            output_pipeline(&result);
+        }
+        output_close();
+        data_free();
+        finishGEOS();
+        return ok ? 0 : 1;
+    }
+
+    timer_calibrate();
+    debug_stderr(1, "TIMER [overhead %0.3gs]\n", timer_overhead);
+
+    /* Without isolation the whole process stays on the core */
+    if (options.cpu >= 0 && !options.isolate)
+        pin_to_cpu(options.cpu);
+
+    if (options.threads == 0)
+        debug_stderr(1, "COUNTERS [%d of %d available]\n", counters_open(), GP_COUNTER_COUNT);
+
     gp_config_func* config_func;
     for (config_func = gp_config_funcs; *config_func != NULL; config_func++)
     {
         gp_test test = (*config_func)();
 
-        // If command-line arguments are provided, interpret them to be the
+        /* Skipped tests have no stages to run */
+        if (test.count_max < 1)
+            continue;
+
+        // If test names are provided after the options, interpret them to be the
         // set of tests we should run and skip tests not included in the list.
-        if (argc > 1) {
+        if (optind < argc) {
             int found = 0;
-            for (int i = 1; i < argc; i++) {
+            for (int i = optind; i < argc; i++) {
                 if (strcmp(test.name, argv[i]) == 0) {
                     found = 1;
                 }
@@ -311,15 +1406,100 @@ main(int argc, char *argv[])
             }
         }
 
-        if (test.count < 1)
+        if (options.threads > 0 && !test.func_thread_run)
+        {
+            debug_stderr(1, "SKIP [%s] no threaded version\n", test.name);
             continue;
+        }
+
+        size_t combo;
+        char params[MAXSTRLEN];
+        for (combo = 0; params_set(test.params, combo, params, MAXSTRLEN); combo++)
+        {
+            if (params[0])
+                log_stderr("PARAM [%s] %s\n", test.name, params);
+
+            const char* missing = test_data_missing(&test);
+            if (missing)
+            {
+                log_stderr("SKIP [%s] data file '%s' not found\n", test.name, missing);
+                continue;
+            }
+
+            if (options.threads > 0)
+            {
+                uint32_t nthreads;
+                double base_ops_per_sec = 0.0;
+                for (nthreads = 1; nthreads <= options.threads; nthreads++)
+                {
+                    gp_throughput result;
+                    log_stderr("  RUN [%s] %u threads ...", test.name, nthreads);
+                    skip_reason[0] = '\0';
+                    if (!run_throughput(&test, nthreads, options.warmup, test.count_min,
+                                        base_ops_per_sec, &result))
+                    {
+                        log_stderr(" skipped\n");
+                        log_stderr(" SKIP [%s] %s\n", test.name,
+                                   skip_reason[0] ? skip_reason : "thread setup failed");
+                        break;
+                    }
+                    log_stderr(" %0.3g ops/s\n", result.ops_per_sec);
+                    if (nthreads == 1)
+                        base_ops_per_sec = result.ops_per_sec;
+                    result.params = params;
+                    output_throughput(&result);
+                }
+                continue;
+            }
 
-        gp_result result = run_test(&test);
-        result_to_csv(&result);
+            gp_result result;
+            if (options.isolate)
+            {
+                if (!run_test_isolated(&test, &result))
+                    continue;
+            }
+            else
+            {
+                result = run_test(&test);
+            }
+            if (result.skipped)
+            {
+                result_free(&result);
+                continue;
+            }
+            result.params = params;
+            output_result(&result);
+            if (samples_file)
+                samples_write(samples_file, &result);
+            if (baseline_file_name)
+                regressions += baseline_compare(&result, threshold);
+            result_free(&result);
+        }
     }
 
+    gp_dataset_stats dstats;
+    dataset_stats(&dstats);
+    if (dstats.datasets > 0)
+        log_stderr("DATASETS [%u loaded in %0.3gs, holding %0.3g MB; %u of %u uses shared, saving %0.3gs of setup]\n",
+            dstats.datasets, dstats.load_time, dstats.bytes / 1048576.0,
+            dstats.shared, dstats.acquires, dstats.saved_time);
+    dataset_free_all();
+
+    /* The output lists the data files checked, so goes first */
+    output_close();
+    data_free();
+    counters_close();
     finishGEOS();
 
+    if (samples_file)
+        fclose(samples_file);
+    baseline_free();
+    sweep_free();
+
+    if (regressions > 0)
+    {
+        log_stderr("REGRESSION [%d tests slower than the baseline]\n", regressions);
+        return 2;
+    }
     return 0;
 }
-
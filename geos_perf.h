@@ -1,3 +1,4 @@
+#include <stdio.h>
 #include <stdint.h>
 
 #include "geos_c.h"
@@ -15,8 +16,8 @@
 */
 #define GEOS_PERF_SKIP(callback_name) \
     gp_test callback_name(void) { \
-    gp_test test; \
-    test.count = 0; \
+    gp_test test = {0}; \
+    test.name = #callback_name; \
     return test; }
 
 
@@ -26,11 +27,46 @@
 */
 typedef void (*gp_func)(void);
 
+/**
+* Tests that can also be run concurrently provide
+* per-thread versions of their steps, working against
+* a private GEOS context. The thread setup returns the
+* thread's own state, which is handed back to the
+* thread run and cleanup steps.
+*/
+typedef void* (*gp_thread_setup_func)(GEOSContextHandle_t ctx);
+typedef void (*gp_thread_func)(GEOSContextHandle_t ctx, void* state);
+
+/**
+* A named test parameter with its default value.
+* Tests keep a static array of these, terminated by
+* an entry with a NULL name, and read the current value
+* with param_get() or param_double() during setup and
+* run. The runner sets value before each setup, from
+* the default or from a command-line sweep.
+*/
+typedef struct {
+    const char* name;
+    const char* default_value;
+    const char* value;
+} gp_param;
+
 /**
 * Each test file has a gp_config_func() that
 * returns a test struct, with the name/metadata
-* the functions to run, and a count of the number
-* of times to run the main test.
+* the functions to run, and the minimum and maximum
+* number of times to run the main test. The runner
+* always does at least count_min iterations, and in
+* adaptive mode keeps going up to count_max until its
+* time budget is spent or the median is precise enough.
+* The thread functions are optional, and are used by the
+* multi-threaded throughput mode. A thread setup can skip the
+* test like setup does, with skip_report(), and return NULL. The params are optional
+* named parameter axes that can be swept from the command line.
+* The data files are the files setup reads, in a NULL terminated
+* list, which the runner checks before setup, skipping the test
+* if any is missing. The value of a parameter named "data" is
+* checked as well.
 */
 typedef struct {
     const char* name;
@@ -38,24 +74,235 @@ typedef struct {
     gp_func func_setup;
     gp_func func_run;
     gp_func func_cleanup;
-    uint32_t count;
+    uint32_t count_min;
+    uint32_t count_max;
+    gp_thread_setup_func func_thread_setup;
+    gp_thread_func func_thread_run;
+    gp_thread_func func_thread_cleanup;
+    gp_param* params;
+    const char* const* data_files;
 } gp_test;
 
+/**
+* Summary statistics of the per-iteration run
+* times of a test, in seconds.
+*/
+typedef struct {
+    double min;
+    double p50;
+    double p90;
+    double p99;
+    double max;
+    double mean;
+    double stddev;
+    double p50_ci_lo;
+    double p50_ci_hi;
+} gp_stats;
+
+/**
+* Performance counters captured around each phase
+* of a test. A counter is only valid when the kernel
+* allowed it to be opened and scheduled.
+*/
+enum {
+    GP_COUNTER_CYCLES,
+    GP_COUNTER_INSTRUCTIONS,
+    GP_COUNTER_L1D_MISSES,
+    GP_COUNTER_LLC_MISSES,
+    GP_COUNTER_BRANCH_MISSES,
+    GP_COUNTER_PAGE_FAULTS,
+    GP_COUNTER_CONTEXT_SWITCHES,
+    GP_COUNTER_COUNT
+};
+
+typedef struct {
+    uint64_t values[GP_COUNTER_COUNT];
+    uint8_t valid[GP_COUNTER_COUNT];
+} gp_counters;
+
+/**
+* Allocation counts gathered by the allocation
+* tracker while it is switched on.
+*/
+typedef struct {
+    uint64_t allocs;
+    uint64_t frees;
+    uint64_t bytes;
+    int64_t peak_live_bytes;
+} gp_alloc_stats;
+
+/**
+* The phases of a test run.
+*/
+enum {
+    GP_PHASE_SETUP,
+    GP_PHASE_RUN,
+    GP_PHASE_CLEANUP,
+    GP_PHASE_COUNT
+};
+
+/**
+* Geometry loading done during a test setup: how
+* many data files and geometries were loaded, how long
+* parsing them as WKT takes, and how long the loads that
+* came from the WKB cache took instead. For cached files
+* the WKT time is the one measured when the cache was
+* written.
+*/
+typedef struct {
+    uint32_t files;
+    uint32_t cache_hits;
+    uint32_t threads;
+    uint64_t geoms;
+    double wkt_time;
+    double cache_time;
+} gp_load_stats;
+
 /**
 * The main test runner tracks time for
 * each stage and the number of iterations
 * and returns summary statistics for
-* each test it runs.
+* each test it runs. Every timed iteration of the
+* run stage is kept in the samples array,
+* which is owned by the result. Warmup
+* iterations are not timed. A test that
+* skipped itself in setup has skipped set
+* and no samples.
 */
 typedef struct {
     const char* version;
     const char* name;
+    const char* params;
     double setup_time;
     double run_time;
     double cleanup_time;
+    uint32_t warmup;
     uint32_t count;
+    double* samples;
+    gp_stats stats;
+    gp_counters counters[GP_PHASE_COUNT];
+    int allocs_valid;
+    gp_alloc_stats allocs;
+    long rss_delta[GP_PHASE_COUNT];
+    gp_load_stats load;
+    uint64_t work_items;
+    uint64_t work_bytes;
+    uint64_t features;
+    uint64_t vertices;
+    int skipped;
 } gp_result;
 
+/**
+* The throughput runner executes a test's thread
+* functions on a number of threads at once, and
+* reports the aggregate rate and how well it scales
+* compared to the single-threaded rate.
+*/
+typedef struct {
+    const char* version;
+    const char* name;
+    const char* params;
+    uint32_t threads;
+    uint64_t ops;
+    double wall_time;
+    double ops_per_sec;
+    double efficiency;
+} gp_throughput;
+
+/**
+* A streaming pipeline run applies one operation to
+* every feature of a data file as it is read, keeping
+* at most queue_size lines in memory. Peak memory is
+* the peak resident set size of the process, and its
+* growth during the run, in kB on Linux.
+*/
+typedef struct {
+    const char* version;
+    const char* op;
+    double arg;
+    const char* file_name;
+    uint32_t workers;
+    size_t queue_size;
+    uint64_t features;
+    uint64_t bytes;
+    uint64_t errors;
+    double wall_time;
+    double features_per_sec;
+    double mb_per_sec;
+    size_t peak_queue;
+    uint64_t peak_queue_bytes;
+    uint64_t reader_waits;
+    long peak_rss;
+    long rss_delta;
+} gp_pipeline_result;
+
+/**
+* An A/B comparison of one workload between a
+* baseline library (A) and another library (B).
+* The ratio is the median of the per-iteration
+* B/A time ratios, with a bootstrap 95% CI.
+*/
+typedef struct {
+    const char* name;
+    const char* path_a;
+    const char* version_a;
+    const char* path_b;
+    const char* version_b;
+    uint32_t count;
+    double p50_a;
+    double p50_b;
+    double ratio;
+    double ratio_ci_lo;
+    double ratio_ci_hi;
+} gp_ab_result;
+
+typedef void (*gp_ab_result_func)(const gp_ab_result* result);
+
+/**
+* Checksum of one of the test data files, so that
+* results from different machines can be checked
+* to come from the same inputs.
+*/
+typedef struct {
+    char* name;
+    uint32_t crc32;
+    uint64_t bytes;
+} gp_dataset_checksum;
+
+/**
+* The machine, kernel and build a set of results
+* was measured on.
+*/
+typedef struct {
+    char hostname[MAXSTRLEN];
+    char cpu_model[MAXSTRLEN];
+    long cores;
+    char governor[MAXSTRLEN];
+    char kernel[MAXSTRLEN];
+    const char* compiler;
+    const char* build_type;
+    const char* geos_version;
+    char timestamp[MAXSTRLEN];
+    gp_dataset_checksum* datasets;
+    size_t ndatasets;
+} gp_environment;
+
+/**
+* An output format. The begin and end functions
+* bracket a whole run, and one of the result
+* functions is called for every measurement, as
+* each mode produces its own kind of result.
+*/
+typedef struct {
+    const char* name;
+    void (*begin)(FILE* file, const gp_environment* env);
+    void (*result)(FILE* file, const gp_result* result);
+    void (*throughput)(FILE* file, const gp_throughput* result);
+    void (*ab)(FILE* file, const gp_ab_result* result);
+    void (*pipeline)(FILE* file, const gp_pipeline_result* result);
+    void (*end)(FILE* file, const gp_environment* env);
+} gp_output;
+
 /**
 * Each test must define a config function
 * that produces a test structure for the
@@ -77,26 +324,438 @@ typedef struct {
 
 void geomlist_init(GEOSGeometryList* gl);
 void geomlist_free(GEOSGeometryList* gl);
+void geomlist_free_r(GEOSContextHandle_t ctx, GEOSGeometryList* gl);
 void geomlist_release(GEOSGeometryList* gl);
 void geomlist_print(GEOSGeometryList* gl);
 size_t geomlist_push(GEOSGeometryList* gl, GEOSGeometry *g);
-size_t geomlist_size(GEOSGeometryList* gl);
+size_t geomlist_size(const GEOSGeometryList* gl);
 GEOSGeometry* geomlist_pop(GEOSGeometryList* gl);
-const GEOSGeometry* geomlist_get(GEOSGeometryList* gl, size_t i);
+const GEOSGeometry* geomlist_get(const GEOSGeometryList* gl, size_t i);
+
+/**
+* Bounds of all the geometries of a list, with
+* geom_extent_r. Returns zero, and zero bounds, when
+* every geometry is empty.
+*/
+int geomlist_extent(const GEOSGeometryList* gl, double* xmin, double* ymin, double* xmax, double* ymax);
+
+/**
+* Current value of a test parameter, as a string
+* or converted to a number. Unknown parameters are
+* NULL or zero.
+*/
+const char* param_get(const gp_param* params, const char* name);
+double param_double(const gp_param* params, const char* name);
+
+/**
+* The node_capacity parameter of the STRtree tests.
+* GEOSSTRtree_create crashes below 2, so smaller values
+* skip the test with skip_report() and return zero.
+*/
+size_t param_node_capacity(const gp_param* params);
 
 /**
 * Read a wkt.gz file, with one wkt geometry per line, gzipped.
-* File name is relative to the data directory.
+* File name is looked up in the data directories.
 * Geometry list must be initialized by caller.
 */
 int read_data_file(const char* file_name, GEOSGeometryList* geoms);
 
+/**
+* Read a wkt.gz file like read_data_file(), using
+* the supplied GEOS context.
+*/
+int read_data_file_r(GEOSContextHandle_t ctx, const char* file_name, GEOSGeometryList* geoms);
+
+/**
+* Callback for each line of a data file. The line
+* is NUL terminated, has no line ending, and is only
+* valid during the call. Return non-zero to
+* stop reading.
+*/
+typedef int (*gp_line_func)(const char* line, size_t len, void* data);
+
+/**
+* Read a gzipped text file line by line, calling func
+* on every line. File name is looked up in the data directories.
+*/
+int read_data_lines(const char* file_name, gp_line_func func, void* data);
+
+/**
+* Data files are looked up in the --data-dir directories, in
+* order, and then in the source tree. The path of a file is
+* set even when it isn't found, and the return says whether
+* it was.
+*/
+int data_dir_add(const char* dir);
+size_t data_dirs_get(const char*** dirs);
+int data_path(const char* file_name, char* path, size_t len);
+
+/**
+* Check a data file against the manifest of its directory,
+* once per run. Synthetic datasets are always available.
+*/
+enum {
+    GP_DATA_OK,
+    GP_DATA_MISSING,
+    GP_DATA_MISMATCH
+};
+int data_check(const char* file_name);
+
+/**
+* Feature and vertex counts of a data file, from the manifest
+* or noted when the file was loaded. Returns zero if unknown.
+*/
+int data_counts(const char* file_name, uint64_t* features, uint64_t* vertices);
+int data_counts_known(const char* file_name);
+void data_counts_note(const char* file_name, uint64_t features, uint64_t vertices);
+void data_free(void);
+
+/**
+* Sizes and checksums of the data files checked so far that
+* were found, for the environment of the results. The array
+* and the names in it belong to the caller.
+*/
+size_t data_checksums(gp_dataset_checksum** checksums);
+
+/**
+* Write a manifest of every data file that can be found,
+* and the entries of listed files that can't, to out.
+*/
+int manifest_write(FILE* out);
+
+/**
+* The dataset registry loads each data file once per
+* process and shares it between the tests that use it.
+* Acquire returns a read-only view of the geometries,
+* loading the file on first use, and every acquire must
+* be matched by a release. Datasets stay loaded when
+* their last user releases them, so the next test gets
+* them for free, and are freed by dataset_free_all().
+* Tests that need to own their geometries get clones,
+* appended to a list the caller has initialized.
+* A file that fails to load is not registered: acquire
+* skips the test with skip_report() and returns NULL, and
+* clone returns -1, so setup can return before it
+* allocates anything else.
+*/
+const GEOSGeometryList* dataset_acquire(const char* file_name);
+void dataset_release(const GEOSGeometryList* dataset);
+int dataset_clone(const char* file_name, GEOSGeometryList* geoms);
+void dataset_free_all(void);
+
+/**
+* Registry totals: how many files were loaded and how
+* often they were shared, the time the loads took and
+* the load time saved by sharing, and the heap bytes
+* the loaded datasets hold.
+*/
+typedef struct {
+    uint32_t datasets;
+    uint32_t acquires;
+    uint32_t shared;
+    double load_time;
+    double saved_time;
+    int64_t bytes;
+} gp_dataset_stats;
+
+void dataset_stats(gp_dataset_stats* stats);
+
+/**
+* Loading statistics accumulated by read_data_file()
+* and read_data_file_r() since the last reset.
+*/
+void load_stats_reset(void);
+void load_stats_read(gp_load_stats* stats);
+
+/**
+* Synthetic datasets are generated instead of read when
+* read_data_file(), read_data_file_r() or dataset_acquire()
+* are given a name like synthetic:KIND:COUNT[:VERTICES[:SEED]].
+* KIND is one of uniform, clustered or grid (points), walk
+* (linestrings), polygon, holes or selftouch (polygons). The
+* same name always generates the same geometries.
+* synthetic_kind_known() lets tests check a KIND in setup.
+*/
+int synthetic_is_name(const char* name);
+int synthetic_kind_known(const char* kind);
+int synthetic_generate(GEOSContextHandle_t ctx, const char* name, GEOSGeometryList* geoms);
+
+/**
+* Number of threads read_data_file() parses with,
+* default 1. With more than one, the file is split
+* into line-aligned chunks of about equal size, each
+* parsed by a worker with its own GEOS context.
+*/
+void load_threads_set(uint32_t nthreads);
+uint32_t load_threads_get(void);
+
+/**
+* Parse items [begin, end) of an offset-indexed buffer,
+* where item i starts at offsets[i], into the list,
+* using the given context.
+*/
+typedef void (*gp_parse_range_func)(GEOSContextHandle_t ctx, const unsigned char* data,
+                                    const uint64_t* offsets, size_t begin, size_t end,
+                                    GEOSGeometryList* geoms);
+
+/**
+* Split nitems items into chunks of about equal bytes,
+* one per load thread, parse them concurrently and
+* append the geometries to the list in item order.
+* offsets has nitems + 1 entries.
+*/
+int parse_parallel(const unsigned char* data, const uint64_t* offsets, size_t nitems,
+                   gp_parse_range_func func, GEOSGeometryList* geoms);
+
+/**
+* The WKB cache keeps an indexed WKB copy of each wkt.gz
+* file, keyed by the checksum of the source file, so that
+* later loads can skip WKT parsing. Set the directory the
+* cache files go in, or NULL to switch the cache off.
+*/
+void cache_set_dir(const char* dir);
+
+/**
+* Load a file from the cache into the list, returning
+* 1 on a hit and 0 when there is no valid cache file.
+* On a hit wkt_time is set to the stored WKT parse time.
+*/
+int cache_load(GEOSContextHandle_t ctx, const char* file_name, GEOSGeometryList* geoms, double* wkt_time);
+
+/**
+* Write the geometries loaded from a file to the cache,
+* along with how long the WKT parse took.
+*/
+int cache_store(GEOSContextHandle_t ctx, const char* file_name, GEOSGeometryList* geoms, double wkt_time);
+
 /**
 * Read a wkt.gz file into a single geometry. Assumes the
 * geometry is on a single line.
 */
 GEOSGeometry* read_geometry_file(const char* file_name);
 
+/**
+* Run the thread functions of a test on nthreads threads,
+* each doing warmup untimed and then count timed iterations.
+* The single-threaded rate for the efficiency calculation is
+* passed in as base_ops_per_sec, or zero if this is the
+* single-threaded run. Returns zero, without running any
+* threads, when a thread setup skipped the test.
+*/
+int run_throughput(const gp_test* test, uint32_t nthreads,
+                   uint32_t warmup, uint32_t count,
+                   double base_ops_per_sec, gp_throughput* result);
+
+/**
+* Stream the features of a data file from a reader
+* thread through a bounded queue to nworkers worker
+* threads, which parse each one, apply the operation
+* named by op_spec ("buffer" or "buffer:100", the
+* number being the operation argument) and destroy
+* it. A queue_size of zero uses the default.
+*/
+int run_pipeline(const char* op_spec, const char* file_name, uint32_t nworkers,
+                 size_t queue_size, gp_pipeline_result* result);
+
+/**
+* Load a libgeos_c build for A/B comparison into its
+* own namespace. The first library loaded is the baseline.
+*/
+int ab_load(const char* path);
+void ab_unload(void);
+
+/**
+* Run the A/B workloads (all of them, or those in names)
+* against every loaded library, calling func_result with
+* the comparison of each library to the baseline.
+*/
+int ab_compare(uint32_t warmup, char** names, int nnames, gp_ab_result_func func_result);
+
+/**
+* Tests that process a known amount of data report
+* how many items (features) and bytes a single run
+* iteration handles, usually from setup. The runner
+* turns the median iteration time into items/s and
+* MB/s. The last report before cleanup wins.
+*/
+void work_report(uint64_t items, uint64_t bytes);
+
+/**
+* Tests that measure more than the run time, such as
+* the phases of a run, report them as printf-style
+* lines from their stages. The runner logs them after
+* the run as NOTE lines.
+*/
+void note_report(const char* fmt, ...);
+
+/**
+* Non-zero during the untimed warmup iterations, for
+* tests that keep measurements of their own in the run
+* stage and should only keep those of timed iterations.
+*/
+int warmup_running(void);
+
+/**
+* Tests that cannot run with the parameters they are
+* given, such as a method this GEOS lacks, report why
+* from setup, before acquiring anything. The runner
+* logs it as a SKIP line, does not run or clean up
+* the test, and outputs no result for it.
+*/
+void skip_report(const char* fmt, ...);
+
+/**
+* Write the samples of a result as one line of a
+* samples file, which can be read back as a baseline.
+* Results are matched to the baseline by test name
+* and parameter values.
+*/
+void samples_write(FILE* file, const gp_result* result);
+
+/**
+* Read a samples file written by samples_write() to
+* compare later results against.
+*/
+int baseline_load(const char* file_name);
+void baseline_free(void);
+
+/**
+* Compare a result to its baseline test, logging the
+* speedup or slowdown and its significance. Returns 1
+* if the test is significantly slower by more than the
+* threshold fraction, 0 otherwise.
+*/
+int baseline_compare(const gp_result* result, double threshold);
+
+/**
+* Fill in the environment of this run, and once the
+* tests have run, the checksums of the data files they
+* used.
+*/
+void environment_collect(gp_environment* env);
+void environment_datasets(gp_environment* env);
+void environment_free(gp_environment* env);
+
+/**
+* CRC-32 and size of a whole file. Returns zero if
+* the file can't be read.
+*/
+int checksum_file(const char* file_name, uint32_t* crc, uint64_t* bytes);
+
+/**
+* Select an output format by name ("csv" or "json")
+* and the file to write to, stdout when file_name is
+* NULL. Results are written as they are passed in.
+*/
+int output_open(const char* format, const char* file_name);
+void output_result(const gp_result* result);
+void output_throughput(const gp_throughput* result);
+void output_ab(const gp_ab_result* result);
+void output_pipeline(const gp_pipeline_result* result);
+void output_close(void);
+
+/**
+* Open the performance counters for this process,
+* returning the number that are available.
+*/
+int counters_open(void);
+void counters_close(void);
+
+/**
+* Reset and start the counters, then stop and
+* read them into the counters struct.
+*/
+void counters_start(void);
+void counters_stop(gp_counters* counters);
+
+/**
+* Short name of a counter, for output headers.
+*/
+const char* counters_name(int counter);
+
+/**
+* Allocation tracking of malloc/realloc/free calls,
+* available on glibc only. Counts accumulate between
+* start and stop calls until the next reset.
+*/
+int alloc_tracking_available(void);
+void alloc_tracking_reset(void);
+void alloc_tracking_start(void);
+void alloc_tracking_stop(void);
+void alloc_tracking_read(gp_alloc_stats* stats);
+
+/**
+* Peak resident set size of the process so far,
+* as reported by getrusage().
+*/
+long peak_rss(void);
+
+/**
+* Bytes of heap in use, from mallinfo2() on glibc
+* 2.33 and newer, and 0 where it isn't available.
+*/
+int64_t heap_in_use(void);
+
+/**
+* Seconds on the monotonic clock, for the runner and
+* for tests that time steps of their own.
+*/
+double seconds_now(void);
+
+/**
+* Seeded pseudo-random numbers. The state is
+* any 64-bit seed, and is advanced on every call.
+*/
+uint64_t random_next(uint64_t* state);
+double random_double(uint64_t* state);
+
+/**
+* Sort an array of samples in place.
+*/
+void stats_sort(double* samples, size_t nsamples);
+
+/**
+* Percentile (0-100) of an array already sorted
+* with stats_sort().
+*/
+double stats_percentile(const double* sorted, size_t nsamples, double pct);
+
+/**
+* Distribution-free 95% confidence interval on the median
+* of an array already sorted with stats_sort(). Returns
+* zero and leaves the bounds alone when there are too few
+* samples to bound the median.
+*/
+int stats_median_ci(const double* sorted, size_t nsamples, double* lo, double* hi);
+
+/**
+* 95% percentile bootstrap confidence interval on the
+* median of a set of samples, with a fixed seed.
+*/
+void stats_bootstrap_median_ci(const double* samples, size_t nsamples,
+                               uint32_t resamples, double* lo, double* hi);
+
+/**
+* 95% bootstrap confidence interval on the ratio of
+* medians median(b) / median(a) of two independent
+* sets of samples, with a fixed seed.
+*/
+void stats_bootstrap_ratio_ci(const double* a, size_t na,
+                              const double* b, size_t nb,
+                              uint32_t resamples, double* lo, double* hi);
+
+/**
+* Two-sided p-value of the Mann-Whitney U test that
+* two sets of samples come from the same distribution.
+*/
+double stats_mann_whitney(const double* a, size_t na, const double* b, size_t nb);
+
+/**
+* Fill in the summary statistics for a set of samples.
+*/
+void stats_compute(const double* samples, size_t nsamples, gp_stats* stats);
+
 /**
 * Write a debugging message to stderr if the debug level
 * is higher than the threshold.
@@ -104,10 +763,115 @@ GEOSGeometry* read_geometry_file(const char* file_name);
 void debug_stderr(uint32_t level, const char* fmt, ...);
 
 /**
-* GEOS < 3.7 does not have GEOSGeom_createPointFromXY
+* Orders the features of a data file can be loaded in:
+* as in the file, along a Hilbert or Morton curve
+* through their envelope centers, or shuffled.
+*/
+enum {
+    GP_ORDER_ORIGINAL,
+    GP_ORDER_HILBERT,
+    GP_ORDER_MORTON,
+    GP_ORDER_SHUFFLE,
+    GP_ORDER_COUNT
+};
+
+/**
+* Order to load data files in from now on, by name.
+* Set returns zero and parse -1 for unknown names.
+*/
+int order_parse(const char* name);
+int order_set(const char* name);
+int order_get(void);
+const char* order_name(int order);
+
+/**
+* Reorder the geometries of a list from begin on into the
+* current order, cloning them so their memory follows it.
+* The context may be NULL.
+*/
+void order_apply(GEOSContextHandle_t ctx, GEOSGeometryList* geoms, size_t begin);
+
+/**
+* Structure-of-arrays coordinate store. The ordinates
+* of every coordinate are held in x and y, and again
+* interleaved in xy. Sequence, part and feature runs
+* are given by start offsets, with one extra entry
+* at the end of each array.
+*/
+typedef struct {
+    double* x;
+    double* y;
+    double* xy;
+    size_t ncoords;
+    size_t* seq_start;     /* into the coordinates */
+    size_t nseqs;
+    size_t* part_start;    /* into the sequences */
+    size_t nparts;
+    size_t* feature_start; /* into the parts */
+    int* types;            /* GEOSGeomTypes of each feature */
+    size_t nfeatures;
+} gp_coord_store;
+
+/**
+* Ways to build geometries from, and extract coordinates
+* into, a coordinate store: per-ordinate setters/getters,
+* per-coordinate XY calls, and bulk buffer or array
+* copies. Not all are available in older GEOS versions.
+*/
+enum {
+    GP_COORDS_SETTERS,
+    GP_COORDS_XY,
+    GP_COORDS_BUFFER,
+    GP_COORDS_ARRAYS,
+    GP_COORDS_METHOD_COUNT
+};
+
+/**
+* Method by name ("setters", "xy", "buffer" or "arrays"),
+* or -1 if it is unknown or unavailable in this GEOS.
+*/
+int coords_method(const char* name);
+int coords_method_available(int method);
+
+/**
+* Copy the coordinates of points, linestrings, polygons
+* and their multi types into a new store. Returns zero
+* for other geometry types.
+*/
+int coords_from_geoms(const GEOSGeometryList* geoms, gp_coord_store* store);
+void coords_free(gp_coord_store* store);
+
+/**
+* Build one feature of the store into a new geometry.
+*/
+GEOSGeometry* coords_build(const gp_coord_store* store, size_t feature, int method);
+
+/**
+* Copy the coordinates of a geometry into a store laid
+* out for it, starting at coordinate offset, into x and
+* y or into xy depending on the method. Returns the
+* number of coordinates copied.
+*/
+size_t coords_extract(const GEOSGeometry* g, gp_coord_store* store, size_t offset, int method);
+
+/**
+* GEOS < 3.8 does not have GEOSGeom_createPointFromXY
 */
 GEOSGeometry* createPointFromXY(double x, double y);
 
+/**
+* GEOS < 3.11 does not have GEOSGeom_createRectangle
+*/
+GEOSGeometry* createRectangle(double xmin, double ymin, double xmax, double ymax);
+
+/**
+* Bounds of a geometry, with GEOSGeom_getExtent_r, the
+* GEOSGeom_getXMin_r family on GEOS 3.7 to 3.10, or the
+* envelope before that. Returns zero for empty geometries.
+*/
+int geom_extent_r(GEOSContextHandle_t ctx, const GEOSGeometry* g,
+                  double* xmin, double* ymin, double* xmax, double* ymax);
+
 /**
 * Global to hold debug level for this run
 * currently unused
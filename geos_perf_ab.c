@@ -0,0 +1,343 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dlfcn.h>
+
+#include "geos_perf.h"
+
+/************************************************************************
+* In-process A/B comparison of several libgeos_c builds.
+*
+* Each library is loaded with dlmopen() into its own link map
+* namespace, so builds that share a soname (two builds of the same
+* version, say) keep separate copies of libgeos and its C++ runtime.
+* The C API is reached through a table of function pointers looked
+* up in each library. Only the reentrant API is used, with one
+* context per library, and geometries never cross libraries: each
+* library parses the workload's WKT lines with its own reader.
+*
+* Iterations are interleaved across libraries, alternating the
+* order on every iteration (A B, B A, A B, ...) so that thermal and
+* frequency drift affects every library equally. Each library is
+* compared to the first one through the per-iteration paired ratios.
+*/
+
+typedef struct {
+    const char* path;
+    void* handle;
+    const char* version;
+    GEOSContextHandle_t ctx;
+
+    const char* (*GEOSversion)(void);
+    GEOSContextHandle_t (*GEOS_init_r)(void);
+    void (*GEOS_finish_r)(GEOSContextHandle_t);
+    GEOSWKTReader* (*GEOSWKTReader_create_r)(GEOSContextHandle_t);
+    void (*GEOSWKTReader_destroy_r)(GEOSContextHandle_t, GEOSWKTReader*);
+    GEOSGeometry* (*GEOSWKTReader_read_r)(GEOSContextHandle_t, GEOSWKTReader*, const char*);
+    void (*GEOSGeom_destroy_r)(GEOSContextHandle_t, GEOSGeometry*);
+    GEOSGeometry* (*GEOSBuffer_r)(GEOSContextHandle_t, const GEOSGeometry*, double, int);
+    char (*GEOSisValid_r)(GEOSContextHandle_t, const GEOSGeometry*);
+    GEOSGeometry* (*GEOSDelaunayTriangulation_r)(GEOSContextHandle_t, const GEOSGeometry*, double, int);
+} gp_geos_api;
+
+/* Workloads run the same operation against each library */
+typedef void (*gp_ab_func)(const gp_geos_api* api, GEOSGeometryList* geoms);
+
+typedef struct {
+    const char* name;
+    const char* file_name;
+    uint32_t count;
+    gp_ab_func func_run;
+} gp_ab_workload;
+
+static void
+ab_buffer(const gp_geos_api* api, GEOSGeometryList* geoms)
+{
+    size_t i;
+    for (i = 0; i < geomlist_size(geoms); i++)
+    {
+        GEOSGeometry* buffer = api->GEOSBuffer_r(api->ctx, geomlist_get(geoms, i), 100.0, 24);
+        api->GEOSGeom_destroy_r(api->ctx, buffer);
+    }
+}
+
+static void
+ab_isvalid(const gp_geos_api* api, GEOSGeometryList* geoms)
+{
+    size_t i;
+    for (i = 0; i < geomlist_size(geoms); i++)
+        api->GEOSisValid_r(api->ctx, geomlist_get(geoms, i));
+}
+
+static void
+ab_delaunay(const gp_geos_api* api, GEOSGeometryList* geoms)
+{
+    GEOSGeometry* delaunay;
+    if (geomlist_size(geoms) < 1)
+        return;
+    delaunay = api->GEOSDelaunayTriangulation_r(api->ctx, geomlist_get(geoms, 0), 0.0, 1);
+    if (delaunay)
+        api->GEOSGeom_destroy_r(api->ctx, delaunay);
+}
+
+/* Names match the equivalent tests */
+static const gp_ab_workload ab_workloads[] =
+{
+    {"Watershed buffer", "watersheds.wkt.gz", 5, ab_buffer},
+    {"Watershed isValid", "watersheds.wkt.gz", 30, ab_isvalid},
+    {"Delaunay", "multipoint_random_1000.wkt.gz", 2000, ab_delaunay},
+    {NULL, NULL, 0, NULL}
+};
+
+#define AB_MAX_LIBRARIES 8
+#define AB_BOOTSTRAP_RESAMPLES 2000
+
+static gp_geos_api ab_libraries[AB_MAX_LIBRARIES];
+static uint32_t ab_nlibraries = 0;
+
+static void
+ab_log_stderr(const char* message, void* userdata)
+{
+    debug_stderr(1, "%s\n", message);
+}
+
+#define AB_LOOKUP(api, sym) \
+    if (!((api)->sym = dlsym((api)->handle, #sym))) { \
+        fprintf(stderr, "%s: missing symbol %s\n", (api)->path, #sym); \
+        return 0; \
+    }
+
+static int
+ab_lookup(gp_geos_api* api)
+{
+    GEOSMessageHandler_r (*set_notice)(GEOSContextHandle_t, GEOSMessageHandler_r, void*);
+    GEOSMessageHandler_r (*set_error)(GEOSContextHandle_t, GEOSMessageHandler_r, void*);
+
+    AB_LOOKUP(api, GEOSversion);
+    AB_LOOKUP(api, GEOS_init_r);
+    AB_LOOKUP(api, GEOS_finish_r);
+    AB_LOOKUP(api, GEOSWKTReader_create_r);
+    AB_LOOKUP(api, GEOSWKTReader_destroy_r);
+    AB_LOOKUP(api, GEOSWKTReader_read_r);
+    AB_LOOKUP(api, GEOSGeom_destroy_r);
+    AB_LOOKUP(api, GEOSBuffer_r);
+    AB_LOOKUP(api, GEOSisValid_r);
+    AB_LOOKUP(api, GEOSDelaunayTriangulation_r);
+
+    api->version = api->GEOSversion();
+    api->ctx = api->GEOS_init_r();
+
+    /* Older libraries only have the printf-style handlers */
+    set_notice = dlsym(api->handle, "GEOSContext_setNoticeMessageHandler_r");
+    set_error = dlsym(api->handle, "GEOSContext_setErrorMessageHandler_r");
+    if (set_notice && set_error)
+    {
+        set_notice(api->ctx, ab_log_stderr, NULL);
+        set_error(api->ctx, ab_log_stderr, NULL);
+    }
+    return 1;
+}
+
+int
+ab_load(const char* path)
+{
+    gp_geos_api* api;
+    if (ab_nlibraries >= AB_MAX_LIBRARIES)
+    {
+        fprintf(stderr, "at most %d libraries can be compared\n", AB_MAX_LIBRARIES);
+        return 0;
+    }
+    api = ab_libraries + ab_nlibraries;
+    memset(api, 0, sizeof(gp_geos_api));
+    api->path = path;
+#ifdef LM_ID_NEWLM
+    api->handle = dlmopen(LM_ID_NEWLM, path, RTLD_NOW | RTLD_LOCAL);
+#else
+    api->handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+#endif
+    if (!api->handle)
+    {
+        fprintf(stderr, "unable to load %s: %s\n", path, dlerror());
+        return 0;
+    }
+    if (!ab_lookup(api))
+    {
+        dlclose(api->handle);
+        return 0;
+    }
+    ab_nlibraries++;
+    return 1;
+}
+
+void
+ab_unload(void)
+{
+    uint32_t i;
+    for (i = 0; i < ab_nlibraries; i++)
+    {
+        ab_libraries[i].GEOS_finish_r(ab_libraries[i].ctx);
+        dlclose(ab_libraries[i].handle);
+    }
+    ab_nlibraries = 0;
+}
+
+/* The raw WKT lines of a workload's data file */
+typedef struct {
+    char** lines;
+    size_t nlines;
+    size_t capacity;
+} gp_lines;
+
+static int
+ab_push_line(const char* line, size_t len, void* data)
+{
+    gp_lines* list = (gp_lines*)data;
+    if (list->nlines >= list->capacity)
+    {
+        list->capacity = list->capacity ? 2 * list->capacity : 64;
+        list->lines = realloc(list->lines, sizeof(char*) * list->capacity);
+    }
+    list->lines[list->nlines++] = strdup(line);
+    return 0;
+}
+
+static void
+ab_lines_free(gp_lines* lines)
+{
+    size_t i;
+    for (i = 0; i < lines->nlines; i++)
+        free(lines->lines[i]);
+    free(lines->lines);
+}
+
+static void
+ab_parse(const gp_geos_api* api, const gp_lines* lines, GEOSGeometryList* geoms)
+{
+    size_t i;
+    GEOSWKTReader* reader = api->GEOSWKTReader_create_r(api->ctx);
+    geomlist_init(geoms);
+    for (i = 0; i < lines->nlines; i++)
+    {
+        GEOSGeometry* g = api->GEOSWKTReader_read_r(api->ctx, reader, lines->lines[i]);
+        if (g)
+            geomlist_push(geoms, g);
+    }
+    api->GEOSWKTReader_destroy_r(api->ctx, reader);
+}
+
+static void
+ab_free(const gp_geos_api* api, GEOSGeometryList* geoms)
+{
+    size_t i;
+    for (i = 0; i < geoms->ngeoms; i++)
+        api->GEOSGeom_destroy_r(api->ctx, geoms->geoms[i]);
+    geomlist_release(geoms);
+}
+
+static void
+ab_run_workload(const gp_ab_workload* workload, uint32_t warmup, gp_ab_result_func func_result)
+{
+    uint32_t i, l;
+    gp_lines lines = {0};
+    GEOSGeometryList geoms[AB_MAX_LIBRARIES];
+    double* samples[AB_MAX_LIBRARIES];
+    double* ratios = malloc(sizeof(double) * workload->count);
+
+    fprintf(stderr, "SETUP [%s] %u libraries\n", workload->name, ab_nlibraries);
+    if (read_data_lines(workload->file_name, ab_push_line, &lines))
+    {
+        fprintf(stderr, " SKIP [%s] data file '%s' could not be read\n",
+            workload->name, workload->file_name);
+        ab_lines_free(&lines);
+        free(ratios);
+        return;
+    }
+    for (l = 0; l < ab_nlibraries; l++)
+    {
+        ab_parse(ab_libraries + l, &lines, geoms + l);
+        samples[l] = malloc(sizeof(double) * workload->count);
+        for (i = 0; i < warmup; i++)
+            workload->func_run(ab_libraries + l, geoms + l);
+    }
+
+    fprintf(stderr, "  RUN [%s] %u interleaved iterations\n", workload->name, workload->count);
+    for (i = 0; i < workload->count; i++)
+    {
+        uint32_t k;
+        for (k = 0; k < ab_nlibraries; k++)
+        {
+            double start;
+            /* Alternate the order on every iteration */
+            l = (i % 2) ? ab_nlibraries - 1 - k : k;
+            start = seconds_now();
+            workload->func_run(ab_libraries + l, geoms + l);
+            samples[l][i] = seconds_now() - start;
+        }
+    }
+
+    for (l = 1; l < ab_nlibraries; l++)
+    {
+        gp_ab_result result;
+        double* sorted_a = malloc(sizeof(double) * workload->count);
+        double* sorted_b = malloc(sizeof(double) * workload->count);
+        memcpy(sorted_a, samples[0], sizeof(double) * workload->count);
+        memcpy(sorted_b, samples[l], sizeof(double) * workload->count);
+        stats_sort(sorted_a, workload->count);
+        stats_sort(sorted_b, workload->count);
+
+        for (i = 0; i < workload->count; i++)
+            ratios[i] = samples[0][i] > 0.0 ? samples[l][i] / samples[0][i] : 1.0;
+
+        result.name = workload->name;
+        result.path_a = ab_libraries[0].path;
+        result.version_a = ab_libraries[0].version;
+        result.path_b = ab_libraries[l].path;
+        result.version_b = ab_libraries[l].version;
+        result.count = workload->count;
+        result.p50_a = stats_percentile(sorted_a, workload->count, 50.0);
+        result.p50_b = stats_percentile(sorted_b, workload->count, 50.0);
+        stats_sort(ratios, workload->count);
+        result.ratio = stats_percentile(ratios, workload->count, 50.0);
+        stats_bootstrap_median_ci(ratios, workload->count, AB_BOOTSTRAP_RESAMPLES,
+                                  &result.ratio_ci_lo, &result.ratio_ci_hi);
+        func_result(&result);
+        free(sorted_a);
+        free(sorted_b);
+    }
+
+    for (l = 0; l < ab_nlibraries; l++)
+    {
+        ab_free(ab_libraries + l, geoms + l);
+        free(samples[l]);
+    }
+    ab_lines_free(&lines);
+    free(ratios);
+}
+
+int
+ab_compare(uint32_t warmup, char** names, int nnames, gp_ab_result_func func_result)
+{
+    const gp_ab_workload* workload;
+    if (ab_nlibraries < 2)
+    {
+        fprintf(stderr, "at least two libraries are needed for a comparison\n");
+        return 0;
+    }
+    for (workload = ab_workloads; workload->name; workload++)
+    {
+        if (nnames > 0)
+        {
+            int i, found = 0;
+            for (i = 0; i < nnames; i++)
+            {
+                if (strcmp(workload->name, names[i]) == 0)
+                    found = 1;
+            }
+            if (!found)
+                continue;
+        }
+        ab_run_workload(workload, warmup, func_result);
+    }
+    return 1;
+}
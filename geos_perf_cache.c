@@ -0,0 +1,225 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "geos_perf.h"
+
+/************************************************************************
+* WKB cache of the test data files.
+*
+* The first load of a wkt.gz file writes its geometries to
+* <cache dir>/<file name>.<crc32>.wkb, named after the checksum
+* of the compressed source so an edited data file never matches
+* an old cache file. The cache file is a header, an index of
+* count + 1 offsets into the WKB area, and the WKB of every
+* geometry in file order:
+*
+*   header | uint64 offsets[count + 1] | wkb wkb wkb ...
+*
+* Everything is in native byte order, as the cache never leaves
+* the machine that wrote it. Loads mmap the file and hand each
+* WKB straight from the mapping to GEOSWKBReader_read. Cache
+* files are written to a temporary name and renamed into place,
+* so concurrent runs never see a partial file.
+*/
+
+#define CACHE_MAGIC "GPWKB01"
+
+typedef struct {
+    char magic[8];
+    uint32_t source_crc32;
+    uint32_t reserved;
+    uint64_t count;
+    double wkt_time;
+} gp_cache_header;
+
+#ifdef CACHE_DIR
+static const char* cache_dir = CACHE_DIR;
+#else
+static const char* cache_dir = NULL;
+#endif
+
+void
+cache_set_dir(const char* dir)
+{
+    cache_dir = dir;
+}
+
+/* Name of the cache file for the current contents of file_name */
+static int
+cache_file_name(const char* file_name, char* cache_name, size_t len, uint32_t* crc)
+{
+    char full_file_name[MAXSTRLEN];
+    uint64_t bytes;
+    if (!cache_dir)
+        return 0;
+    data_path(file_name, full_file_name, MAXSTRLEN);
+    if (!checksum_file(full_file_name, crc, &bytes))
+        return 0;
+    snprintf(cache_name, len, "%s/%s.%08x.wkb", cache_dir, file_name, *crc);
+    return 1;
+}
+
+static void
+parse_wkb_range(GEOSContextHandle_t ctx, const unsigned char* wkb,
+                const uint64_t* offsets, size_t begin, size_t end,
+                GEOSGeometryList* geoms)
+{
+    size_t i;
+    GEOSWKBReader* reader = GEOSWKBReader_create_r(ctx);
+    for (i = begin; i < end; i++)
+    {
+        GEOSGeometry* g = GEOSWKBReader_read_r(ctx, reader, wkb + offsets[i], offsets[i + 1] - offsets[i]);
+        if (g)
+            geomlist_push(geoms, g);
+    }
+    GEOSWKBReader_destroy_r(ctx, reader);
+}
+
+int
+cache_load(GEOSContextHandle_t ctx, const char* file_name, GEOSGeometryList* geoms, double* wkt_time)
+{
+    char cache_name[MAXSTRLEN];
+    uint32_t crc;
+    const gp_cache_header* header;
+    const uint64_t* offsets;
+    const unsigned char* wkb;
+    unsigned char* map;
+    GEOSWKBReader* reader;
+    struct stat st;
+    size_t index_end;
+    uint64_t i;
+    int fd;
+
+    if (!cache_file_name(file_name, cache_name, MAXSTRLEN, &crc))
+        return 0;
+    fd = open(cache_name, O_RDONLY);
+    if (fd < 0)
+        return 0;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(gp_cache_header))
+    {
+        close(fd);
+        return 0;
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return 0;
+
+    /* Anything that does not add up is a miss, and gets rewritten */
+    header = (const gp_cache_header*)map;
+    offsets = (const uint64_t*)(map + sizeof(gp_cache_header));
+    index_end = sizeof(gp_cache_header) + sizeof(uint64_t) * (header->count + 1);
+    if (memcmp(header->magic, CACHE_MAGIC, sizeof(header->magic)) != 0 ||
+        header->source_crc32 != crc ||
+        header->count >= (uint64_t)st.st_size / sizeof(uint64_t) ||
+        index_end > (size_t)st.st_size ||
+        index_end + offsets[header->count] != (size_t)st.st_size)
+    {
+        munmap(map, st.st_size);
+        return 0;
+    }
+    wkb = map + index_end;
+    *wkt_time = header->wkt_time;
+
+    if (load_threads_get() > 1)
+    {
+        parse_parallel(wkb, offsets, header->count, parse_wkb_range, geoms);
+        munmap(map, st.st_size);
+        return 1;
+    }
+
+    reader = ctx ? GEOSWKBReader_create_r(ctx) : GEOSWKBReader_create();
+    for (i = 0; i < header->count; i++)
+    {
+        size_t size = offsets[i + 1] - offsets[i];
+        GEOSGeometry* g = ctx ?
+            GEOSWKBReader_read_r(ctx, reader, wkb + offsets[i], size) :
+            GEOSWKBReader_read(reader, wkb + offsets[i], size);
+        if (g)
+            geomlist_push(geoms, g);
+    }
+    if (ctx)
+        GEOSWKBReader_destroy_r(ctx, reader);
+    else
+        GEOSWKBReader_destroy(reader);
+
+    munmap(map, st.st_size);
+    return 1;
+}
+
+int
+cache_store(GEOSContextHandle_t ctx, const char* file_name, GEOSGeometryList* geoms, double wkt_time)
+{
+    char cache_name[MAXSTRLEN];
+    char tmp_name[MAXSTRLEN + 32];
+    gp_cache_header header;
+    uint64_t* offsets;
+    GEOSWKBWriter* writer;
+    FILE* file;
+    size_t i, n = geomlist_size(geoms);
+    uint32_t crc;
+    int ok;
+
+    if (!cache_file_name(file_name, cache_name, MAXSTRLEN, &crc))
+        return 0;
+    if (mkdir(cache_dir, 0777) != 0 && errno != EEXIST)
+        return 0;
+    snprintf(tmp_name, sizeof(tmp_name), "%s.%ld.tmp", cache_name, (long)getpid());
+    file = fopen(tmp_name, "wb");
+    if (!file)
+        return 0;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+    header.source_crc32 = crc;
+    header.count = n;
+    header.wkt_time = wkt_time;
+
+    /* The index is written first as a placeholder, and again once the sizes are known */
+    offsets = calloc(n + 1, sizeof(uint64_t));
+    ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+         fwrite(offsets, sizeof(uint64_t), n + 1, file) == n + 1;
+
+    writer = ctx ? GEOSWKBWriter_create_r(ctx) : GEOSWKBWriter_create();
+    if (ctx)
+        GEOSWKBWriter_setOutputDimension_r(ctx, writer, 3);
+    else
+        GEOSWKBWriter_setOutputDimension(writer, 3);
+    for (i = 0; i < n && ok; i++)
+    {
+        size_t size = 0;
+        const GEOSGeometry* g = geomlist_get(geoms, i);
+        unsigned char* wkb = ctx ?
+            GEOSWKBWriter_write_r(ctx, writer, g, &size) :
+            GEOSWKBWriter_write(writer, g, &size);
+        ok = wkb && fwrite(wkb, 1, size, file) == size;
+        offsets[i + 1] = offsets[i] + size;
+        if (ctx)
+            GEOSFree_r(ctx, wkb);
+        else
+            GEOSFree(wkb);
+    }
+    if (ctx)
+        GEOSWKBWriter_destroy_r(ctx, writer);
+    else
+        GEOSWKBWriter_destroy(writer);
+
+    ok = ok &&
+         fseek(file, sizeof(header), SEEK_SET) == 0 &&
+         fwrite(offsets, sizeof(uint64_t), n + 1, file) == n + 1;
+    free(offsets);
+    ok = (fclose(file) == 0) && ok;
+
+    if (!ok || rename(tmp_name, cache_name) != 0)
+    {
+        unlink(tmp_name);
+        return 0;
+    }
+    return 1;
+}
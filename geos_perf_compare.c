@@ -0,0 +1,200 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "geos_perf.h"
+
+/************************************************************************
+* Regression gate against a stored baseline.
+*
+* A samples file holds one line per test, with every timed run
+* iteration, so that a later run can be compared to it with a
+* distribution test rather than by eyeballing totals:
+*
+*   version <TAB> test name <TAB> params <TAB> count <TAB> sample sample ...
+*
+* Each test is compared with a two-sided Mann-Whitney U test on
+* the samples, and the ratio of medians (current / baseline) with a
+* bootstrap 95% confidence interval. A test regresses when it is
+* significantly slower and the ratio exceeds 1 + threshold, or
+* when the whole interval lies above 1 + threshold. With a handful
+* of samples the U test can never reach significance (three runs
+* a side never get below p = 0.05), so only the interval can flag
+* those, and the comparison warns that it is weak.
+*/
+
+#define COMPARE_ALPHA 0.05
+#define COMPARE_RESAMPLES 2000
+#define COMPARE_MIN_SAMPLES 5
+
+typedef struct {
+    char* version;
+    char* name;
+    char* params;
+    double* samples;
+    uint32_t count;
+} gp_baseline;
+
+static gp_baseline* baselines = NULL;
+static size_t nbaselines = 0;
+
+void
+samples_write(FILE* file, const gp_result* result)
+{
+    uint32_t i;
+    fprintf(file, "%s\t%s\t%s\t%u\t", result->version, result->name,
+        result->params ? result->params : "", result->count);
+    for (i = 0; i < result->count; i++)
+        fprintf(file, "%s%.9g", i ? " " : "", result->samples[i]);
+    fprintf(file, "\n");
+    fflush(file);
+}
+
+static int
+baseline_parse(char* line, gp_baseline* baseline)
+{
+    uint32_t i;
+    /* strsep, unlike strtok, keeps the empty params field */
+    char* version = strsep(&line, "\t");
+    char* name = strsep(&line, "\t");
+    char* params = strsep(&line, "\t");
+    char* count = strsep(&line, "\t");
+    char* samples = strsep(&line, "\n");
+    char* end;
+
+    if (!version || !name || !params || !count || !samples)
+        return 0;
+
+    baseline->count = (uint32_t)strtoul(count, NULL, 10);
+    baseline->samples = malloc(sizeof(double) * (baseline->count ? baseline->count : 1));
+    for (i = 0; i < baseline->count; i++)
+    {
+        baseline->samples[i] = strtod(samples, &end);
+        if (end == samples)
+            break;
+        samples = end;
+    }
+    baseline->count = i;
+    baseline->version = strdup(version);
+    baseline->name = strdup(name);
+    baseline->params = strdup(params);
+    return 1;
+}
+
+int
+baseline_load(const char* file_name)
+{
+    char* line = NULL;
+    size_t linecap = 0;
+    size_t capacity = 0;
+    FILE* file = fopen(file_name, "r");
+    if (!file)
+    {
+        fprintf(stderr, "unable to open baseline '%s'\n", file_name);
+        return 0;
+    }
+    while (getline(&line, &linecap, file) > 0)
+    {
+        if (line[0] == '#' || line[0] == '\n')
+            continue;
+        if (nbaselines >= capacity)
+        {
+            capacity = capacity ? 2 * capacity : 16;
+            baselines = realloc(baselines, sizeof(gp_baseline) * capacity);
+        }
+        if (baseline_parse(line, baselines + nbaselines))
+            nbaselines++;
+    }
+    free(line);
+    fclose(file);
+    return 1;
+}
+
+void
+baseline_free(void)
+{
+    size_t i;
+    for (i = 0; i < nbaselines; i++)
+    {
+        free(baselines[i].version);
+        free(baselines[i].name);
+        free(baselines[i].params);
+        free(baselines[i].samples);
+    }
+    free(baselines);
+    baselines = NULL;
+    nbaselines = 0;
+}
+
+static const gp_baseline*
+baseline_find(const char* name, const char* params)
+{
+    size_t i;
+    /* Later lines win, so a baseline file can be appended to */
+    for (i = nbaselines; i > 0; i--)
+    {
+        if (strcmp(baselines[i - 1].name, name) == 0 &&
+            strcmp(baselines[i - 1].params, params ? params : "") == 0)
+            return baselines + i - 1;
+    }
+    return NULL;
+}
+
+int
+baseline_compare(const gp_result* result, double threshold)
+{
+    double p, lo, hi, ratio, median_base, median_current;
+    double* sorted;
+    int regressed;
+    const char* params = result->params ? result->params : "";
+    const gp_baseline* baseline = baseline_find(result->name, params);
+
+    if (!baseline || baseline->count == 0 || result->count == 0)
+    {
+        fprintf(stderr, " COMPARE [%s%s%s] no baseline\n", result->name, *params ? " " : "", params);
+        return 0;
+    }
+
+    sorted = malloc(sizeof(double) * baseline->count);
+    memcpy(sorted, baseline->samples, sizeof(double) * baseline->count);
+    stats_sort(sorted, baseline->count);
+    median_base = stats_percentile(sorted, baseline->count, 50.0);
+    free(sorted);
+    median_current = result->stats.p50;
+
+    /* A zero median has no ratio, so say so rather than print inf or 1x */
+    if (!(median_base > 0.0) || !(median_current > 0.0))
+    {
+        fprintf(stderr, " COMPARE [%s%s%s] not comparable, %s median is %0.3gs\n",
+            result->name, *params ? " " : "", params,
+            median_base > 0.0 ? "current" : "baseline",
+            median_base > 0.0 ? median_current : median_base);
+        return 0;
+    }
+    ratio = median_current / median_base;
+
+    p = stats_mann_whitney(baseline->samples, baseline->count,
+                           result->samples, result->count);
+    stats_bootstrap_ratio_ci(baseline->samples, baseline->count,
+                             result->samples, result->count,
+                             COMPARE_RESAMPLES, &lo, &hi);
+
+    if (baseline->count < COMPARE_MIN_SAMPLES || result->count < COMPARE_MIN_SAMPLES)
+    {
+        fprintf(stderr, " COMPARE [%s%s%s] only %u baseline and %u current samples, need %d for a reliable test\n",
+            result->name, *params ? " " : "", params,
+            baseline->count, result->count, COMPARE_MIN_SAMPLES);
+    }
+
+    regressed = ratio > 1.0 + threshold &&
+        (p < COMPARE_ALPHA || lo > 1.0 + threshold);
+    fprintf(stderr, " COMPARE [%s%s%s] %0.3gx %s than %s (95%% CI %0.3g-%0.3g, p=%0.3g)%s\n",
+        result->name, *params ? " " : "", params,
+        ratio >= 1.0 ? ratio : 1.0 / ratio,
+        ratio >= 1.0 ? "slower" : "faster",
+        baseline->version,
+        lo, hi, p,
+        regressed ? " REGRESSION" :
+        p < COMPARE_ALPHA ? "" : " not significant");
+    return regressed;
+}
@@ -0,0 +1,367 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "geos_perf.h"
+
+/************************************************************************
+* Structure-of-arrays coordinate store.
+*
+* Holds the coordinates of a dataset as flat double arrays, the
+* way services receive them, with just enough structure to build
+* the geometries back: every feature is a run of parts (points,
+* linestrings or polygons), every part a run of sequences (one,
+* or a shell and its holes), and every sequence a run of
+* coordinates. The ordinates are kept both as one array per
+* ordinate and interleaved, so each construction method reads
+* its natural layout without a conversion in the timed loop.
+*
+* Building and extracting can go through the per-ordinate
+* setters and getters, the per-coordinate XY calls (with
+* GEOSGeom_createPointFromXY for points), or the bulk buffer
+* and array copies of GEOS 3.10.
+*/
+
+static const char* coords_method_names[GP_COORDS_METHOD_COUNT] = {
+    "setters", "xy", "buffer", "arrays"
+};
+
+int
+coords_method(const char* name)
+{
+    int method;
+    for (method = 0; method < GP_COORDS_METHOD_COUNT; method++)
+    {
+        if (strcmp(name, coords_method_names[method]) == 0)
+            return coords_method_available(method) ? method : -1;
+    }
+    return -1;
+}
+
+int
+coords_method_available(int method)
+{
+    switch (method)
+    {
+        case GP_COORDS_SETTERS:
+            return 1;
+        case GP_COORDS_XY:
+            return GEOS_VERSION_CMP >= 308;
+        case GP_COORDS_BUFFER:
+        case GP_COORDS_ARRAYS:
+            return GEOS_VERSION_CMP >= 310;
+    }
+    return 0;
+}
+
+/* Number of parts a geometry splits into, or -1 if unsupported */
+static int
+coords_nparts(const GEOSGeometry* g, int type)
+{
+    switch (type)
+    {
+        case GEOS_POINT:
+        case GEOS_LINESTRING:
+        case GEOS_POLYGON:
+            return 1;
+        case GEOS_MULTIPOINT:
+        case GEOS_MULTILINESTRING:
+        case GEOS_MULTIPOLYGON:
+            return GEOSGetNumGeometries(g);
+    }
+    return -1;
+}
+
+static void
+coords_add_seq(gp_coord_store* store, const GEOSGeometry* g)
+{
+    unsigned int i, size = 0;
+    const GEOSCoordSequence* seq = GEOSGeom_getCoordSeq(g);
+    size_t start = store->ncoords;
+    GEOSCoordSeq_getSize(seq, &size);
+    if (store->x)
+    {
+        for (i = 0; i < size; i++)
+        {
+            GEOSCoordSeq_getX(seq, i, store->x + start + i);
+            GEOSCoordSeq_getY(seq, i, store->y + start + i);
+            store->xy[2 * (start + i)] = store->x[start + i];
+            store->xy[2 * (start + i) + 1] = store->y[start + i];
+        }
+        store->seq_start[store->nseqs + 1] = start + size;
+    }
+    store->ncoords += size;
+    store->nseqs++;
+}
+
+static void
+coords_add_part(gp_coord_store* store, const GEOSGeometry* g)
+{
+    int i, nholes;
+    if (GEOSGeomTypeId(g) != GEOS_POLYGON)
+    {
+        coords_add_seq(store, g);
+    }
+    else
+    {
+        coords_add_seq(store, GEOSGetExteriorRing(g));
+        nholes = GEOSGetNumInteriorRings(g);
+        for (i = 0; i < nholes; i++)
+            coords_add_seq(store, GEOSGetInteriorRingN(g, i));
+    }
+    if (store->x)
+        store->part_start[store->nparts + 1] = store->nseqs;
+    store->nparts++;
+}
+
+/*
+* Walk the geometries, counting when the arrays are not yet
+* allocated and filling them in when they are.
+*/
+static int
+coords_walk(gp_coord_store* store, const GEOSGeometryList* geoms)
+{
+    size_t i;
+    int j;
+    for (i = 0; i < geomlist_size(geoms); i++)
+    {
+        const GEOSGeometry* g = geomlist_get(geoms, i);
+        int type = GEOSGeomTypeId(g);
+        int nparts = coords_nparts(g, type);
+        if (nparts < 0)
+        {
+            fprintf(stderr, "coordinate store: unsupported geometry type %d\n", type);
+            return 0;
+        }
+        if (type == GEOS_POINT || type == GEOS_LINESTRING || type == GEOS_POLYGON)
+        {
+            coords_add_part(store, g);
+        }
+        else
+        {
+            for (j = 0; j < nparts; j++)
+                coords_add_part(store, GEOSGetGeometryN(g, j));
+        }
+        if (store->x)
+        {
+            store->types[i] = type;
+            store->feature_start[i + 1] = store->nparts;
+        }
+    }
+    store->nfeatures = geomlist_size(geoms);
+    return 1;
+}
+
+int
+coords_from_geoms(const GEOSGeometryList* geoms, gp_coord_store* store)
+{
+    memset(store, 0, sizeof(gp_coord_store));
+    if (!coords_walk(store, geoms))
+        return 0;
+
+    store->x = malloc(sizeof(double) * (store->ncoords + 1));
+    store->y = malloc(sizeof(double) * (store->ncoords + 1));
+    store->xy = malloc(sizeof(double) * 2 * (store->ncoords + 1));
+    store->seq_start = calloc(store->nseqs + 1, sizeof(size_t));
+    store->part_start = calloc(store->nparts + 1, sizeof(size_t));
+    store->feature_start = calloc(store->nfeatures + 1, sizeof(size_t));
+    store->types = calloc(store->nfeatures + 1, sizeof(int));
+
+    store->ncoords = store->nseqs = store->nparts = 0;
+    return coords_walk(store, geoms);
+}
+
+void
+coords_free(gp_coord_store* store)
+{
+    free(store->x);
+    free(store->y);
+    free(store->xy);
+    free(store->seq_start);
+    free(store->part_start);
+    free(store->feature_start);
+    free(store->types);
+    memset(store, 0, sizeof(gp_coord_store));
+}
+
+
+/************************************************************************
+* Building geometries from the store
+*/
+
+static GEOSCoordSequence*
+coords_build_seq(const gp_coord_store* store, size_t seq, int method)
+{
+    unsigned int i;
+    size_t start = store->seq_start[seq];
+    unsigned int n = (unsigned int)(store->seq_start[seq + 1] - start);
+    GEOSCoordSequence* cs = NULL;
+
+    switch (method)
+    {
+        case GP_COORDS_SETTERS:
+            cs = GEOSCoordSeq_create(n, 2);
+            for (i = 0; i < n; i++)
+            {
+                GEOSCoordSeq_setX(cs, i, store->x[start + i]);
+                GEOSCoordSeq_setY(cs, i, store->y[start + i]);
+            }
+            break;
+#if GEOS_VERSION_CMP >= 308
+        case GP_COORDS_XY:
+            cs = GEOSCoordSeq_create(n, 2);
+            for (i = 0; i < n; i++)
+                GEOSCoordSeq_setXY(cs, i, store->x[start + i], store->y[start + i]);
+            break;
+#endif
+#if GEOS_VERSION_CMP >= 310
+        case GP_COORDS_BUFFER:
+            cs = GEOSCoordSeq_copyFromBuffer(store->xy + 2 * start, n, 0, 0);
+            break;
+        case GP_COORDS_ARRAYS:
+            cs = GEOSCoordSeq_copyFromArrays(store->x + start, store->y + start, NULL, NULL, n);
+            break;
+#endif
+    }
+    return cs;
+}
+
+static GEOSGeometry*
+coords_build_part(const gp_coord_store* store, size_t part, int type, int method)
+{
+    size_t seq = store->part_start[part];
+    size_t nseqs = store->part_start[part + 1] - seq;
+    GEOSGeometry* shell;
+    GEOSGeometry** holes;
+    GEOSGeometry* poly;
+    size_t i;
+
+    switch (type)
+    {
+        case GEOS_POINT:
+#if GEOS_VERSION_CMP >= 308
+            if (method == GP_COORDS_XY && store->seq_start[seq + 1] - store->seq_start[seq] == 1)
+            {
+                size_t c = store->seq_start[seq];
+                return GEOSGeom_createPointFromXY(store->x[c], store->y[c]);
+            }
+#endif
+            return GEOSGeom_createPoint(coords_build_seq(store, seq, method));
+        case GEOS_LINESTRING:
+            return GEOSGeom_createLineString(coords_build_seq(store, seq, method));
+        case GEOS_POLYGON:
+            shell = GEOSGeom_createLinearRing(coords_build_seq(store, seq, method));
+            holes = nseqs > 1 ? malloc(sizeof(GEOSGeometry*) * (nseqs - 1)) : NULL;
+            for (i = 1; i < nseqs; i++)
+                holes[i - 1] = GEOSGeom_createLinearRing(coords_build_seq(store, seq + i, method));
+            poly = GEOSGeom_createPolygon(shell, holes, (unsigned int)(nseqs - 1));
+            free(holes);
+            return poly;
+    }
+    return NULL;
+}
+
+static int
+coords_part_type(int type)
+{
+    switch (type)
+    {
+        case GEOS_MULTIPOINT:
+            return GEOS_POINT;
+        case GEOS_MULTILINESTRING:
+            return GEOS_LINESTRING;
+        case GEOS_MULTIPOLYGON:
+            return GEOS_POLYGON;
+    }
+    return type;
+}
+
+GEOSGeometry*
+coords_build(const gp_coord_store* store, size_t feature, int method)
+{
+    size_t i;
+    int type = store->types[feature];
+    size_t part = store->feature_start[feature];
+    size_t nparts = store->feature_start[feature + 1] - part;
+    GEOSGeometry** parts;
+    GEOSGeometry* g;
+
+    if (type == GEOS_POINT || type == GEOS_LINESTRING || type == GEOS_POLYGON)
+        return coords_build_part(store, part, type, method);
+
+    parts = malloc(sizeof(GEOSGeometry*) * (nparts + 1));
+    for (i = 0; i < nparts; i++)
+        parts[i] = coords_build_part(store, part + i, coords_part_type(type), method);
+    g = GEOSGeom_createCollection(type, parts, (unsigned int)nparts);
+    free(parts);
+    return g;
+}
+
+
+/************************************************************************
+* Extracting coordinates from geometries
+*/
+
+static size_t
+coords_extract_seq(const GEOSGeometry* g, gp_coord_store* store, size_t offset, int method)
+{
+    unsigned int i, size = 0;
+    const GEOSCoordSequence* seq = GEOSGeom_getCoordSeq(g);
+    GEOSCoordSeq_getSize(seq, &size);
+
+    switch (method)
+    {
+        case GP_COORDS_SETTERS:
+            for (i = 0; i < size; i++)
+            {
+                GEOSCoordSeq_getX(seq, i, store->x + offset + i);
+                GEOSCoordSeq_getY(seq, i, store->y + offset + i);
+            }
+            break;
+#if GEOS_VERSION_CMP >= 308
+        case GP_COORDS_XY:
+            for (i = 0; i < size; i++)
+                GEOSCoordSeq_getXY(seq, i, store->xy + 2 * (offset + i), store->xy + 2 * (offset + i) + 1);
+            break;
+#endif
+#if GEOS_VERSION_CMP >= 310
+        case GP_COORDS_BUFFER:
+            GEOSCoordSeq_copyToBuffer(seq, store->xy + 2 * offset, 0, 0);
+            break;
+        case GP_COORDS_ARRAYS:
+            GEOSCoordSeq_copyToArrays(seq, store->x + offset, store->y + offset, NULL, NULL);
+            break;
+#endif
+    }
+    return size;
+}
+
+static size_t
+coords_extract_part(const GEOSGeometry* g, gp_coord_store* store, size_t offset, int method)
+{
+    int i, nholes;
+    size_t n;
+    if (GEOSGeomTypeId(g) != GEOS_POLYGON)
+        return coords_extract_seq(g, store, offset, method);
+
+    n = coords_extract_seq(GEOSGetExteriorRing(g), store, offset, method);
+    nholes = GEOSGetNumInteriorRings(g);
+    for (i = 0; i < nholes; i++)
+        n += coords_extract_seq(GEOSGetInteriorRingN(g, i), store, offset + n, method);
+    return n;
+}
+
+size_t
+coords_extract(const GEOSGeometry* g, gp_coord_store* store, size_t offset, int method)
+{
+    int i, nparts;
+    size_t n = 0;
+    int type = GEOSGeomTypeId(g);
+    if (type == GEOS_POINT || type == GEOS_LINESTRING || type == GEOS_POLYGON)
+        return coords_extract_part(g, store, offset, method);
+
+    nparts = GEOSGetNumGeometries(g);
+    for (i = 0; i < nparts; i++)
+        n += coords_extract_part(GEOSGetGeometryN(g, i), store, offset + n, method);
+    return n;
+}
@@ -0,0 +1,238 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include "geos_perf.h"
+
+/************************************************************************
+* Hardware and software performance counters, read around each
+* phase of a test with the Linux perf_event_open interface.
+*
+* The counters are opened in two groups, one of hardware events
+* led by the cycle counter and one of software events led by the
+* page fault counter, so each group is scheduled onto the PMU as a
+* unit and its values are comparable. Hardware events only count
+* user space, which the default perf_event_paranoid setting allows.
+* Software events include the kernel, where they happen, and when
+* that is refused the page fault counter is reopened for user space
+* only, while context switches are given up. Any counter (or whole
+* group) the kernel refuses is simply marked invalid.
+*
+* The counters follow the calling thread only. They are not
+* inherited, since group reads of inherited counters need a recent
+* kernel, so threads a test starts inside a phase, like those of the
+* partitioned join, are not counted.
+*/
+
+static const char* counter_names[GP_COUNTER_COUNT] =
+{
+    "cycles",
+    "instructions",
+    "l1d_misses",
+    "llc_misses",
+    "branch_misses",
+    "page_faults",
+    "context_switches"
+};
+
+const char*
+counters_name(int counter)
+{
+    return counter_names[counter];
+}
+
+#ifdef __linux__
+
+typedef struct {
+    uint32_t type;
+    uint64_t config;
+} gp_counter_event;
+
+static const gp_counter_event counter_events[GP_COUNTER_COUNT] =
+{
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+                         (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                         (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES}
+};
+
+/* The first counter in each group is its leader */
+#define GP_COUNTER_GROUPS 2
+static const int group_first[GP_COUNTER_GROUPS] = {GP_COUNTER_CYCLES, GP_COUNTER_PAGE_FAULTS};
+static const int group_last[GP_COUNTER_GROUPS] = {GP_COUNTER_BRANCH_MISSES, GP_COUNTER_CONTEXT_SWITCHES};
+
+static int counter_fds[GP_COUNTER_COUNT];
+/* Position of each counter within its group's read buffer */
+static int counter_slot[GP_COUNTER_COUNT];
+static int counters_opened = 0;
+
+static int
+perf_event_open(struct perf_event_attr* attr, int group_fd)
+{
+    return (int)syscall(__NR_perf_event_open, attr, 0, -1, group_fd, 0);
+}
+
+int
+counters_open(void)
+{
+    int g, i, navailable = 0;
+
+    for (i = 0; i < GP_COUNTER_COUNT; i++)
+        counter_fds[i] = -1;
+
+    for (g = 0; g < GP_COUNTER_GROUPS; g++)
+    {
+        int leader = -1, slot = 0;
+        for (i = group_first[g]; i <= group_last[g]; i++)
+        {
+            struct perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = counter_events[i].type;
+            attr.config = counter_events[i].config;
+            attr.disabled = leader < 0;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP |
+                               PERF_FORMAT_TOTAL_TIME_ENABLED |
+                               PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+            /*
+            * Software events happen in the kernel, so they are only
+            * counted with it included. Context switches read 0 without
+            * it, but page faults taken in user space still count.
+            */
+            attr.exclude_kernel = attr.type != PERF_TYPE_SOFTWARE;
+            counter_fds[i] = perf_event_open(&attr, leader);
+            if (counter_fds[i] < 0 && i == GP_COUNTER_PAGE_FAULTS)
+            {
+                attr.exclude_kernel = 1;
+                counter_fds[i] = perf_event_open(&attr, leader);
+            }
+            if (counter_fds[i] < 0)
+            {
+                debug_stderr(1, "COUNTERS [%s unavailable]\n", counter_names[i]);
+                /* Without a leader there is no group */
+                if (leader < 0)
+                    break;
+                continue;
+            }
+            if (leader < 0)
+                leader = counter_fds[i];
+            counter_slot[i] = slot++;
+            navailable++;
+        }
+    }
+    counters_opened = 1;
+    return navailable;
+}
+
+void
+counters_close(void)
+{
+    int i;
+    if (!counters_opened)
+        return;
+    for (i = 0; i < GP_COUNTER_COUNT; i++)
+    {
+        if (counter_fds[i] >= 0)
+            close(counter_fds[i]);
+        counter_fds[i] = -1;
+    }
+    counters_opened = 0;
+}
+
+void
+counters_start(void)
+{
+    int g;
+    if (!counters_opened)
+        return;
+    for (g = 0; g < GP_COUNTER_GROUPS; g++)
+    {
+        int leader = counter_fds[group_first[g]];
+        if (leader < 0)
+            continue;
+        ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+}
+
+void
+counters_stop(gp_counters* counters)
+{
+    int g, i;
+    memset(counters, 0, sizeof(gp_counters));
+    if (!counters_opened)
+        return;
+
+    for (g = 0; g < GP_COUNTER_GROUPS; g++)
+    {
+        /* nr, time_enabled, time_running, then one value per member */
+        uint64_t buf[3 + GP_COUNTER_COUNT];
+        uint64_t enabled, running;
+        int leader = counter_fds[group_first[g]];
+        if (leader < 0)
+            continue;
+
+        ioctl(leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+        if (read(leader, buf, sizeof(buf)) < (ssize_t)(3 * sizeof(uint64_t)))
+            continue;
+
+        enabled = buf[1];
+        running = buf[2];
+        /* Group never got onto the PMU */
+        if (running == 0)
+            continue;
+
+        for (i = group_first[g]; i <= group_last[g]; i++)
+        {
+            double value;
+            if (counter_fds[i] < 0 || (uint64_t)counter_slot[i] >= buf[0])
+                continue;
+            /* Scale up if the group was multiplexed with other users */
+            value = (double)buf[3 + counter_slot[i]];
+            if (running < enabled)
+                value *= (double)enabled / (double)running;
+            counters->values[i] = (uint64_t)value;
+            counters->valid[i] = 1;
+        }
+    }
+}
+
+#else
+
+int
+counters_open(void)
+{
+    return 0;
+}
+
+void
+counters_close(void)
+{
+}
+
+void
+counters_start(void)
+{
+}
+
+void
+counters_stop(gp_counters* counters)
+{
+    memset(counters, 0, sizeof(gp_counters));
+}
+
+#endif
@@ -0,0 +1,174 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "geos_perf.h"
+
+/************************************************************************
+* Dataset registry.
+*
+* Most tests read the same few data files, and parsing them is
+* most of the setup time. The registry keeps one copy of each
+* file per process, loaded with the global GEOS handle, and hands
+* out the same list to every test. The reference count only
+* tracks who is using a dataset; datasets stay loaded until exit
+* since the tests run one after another and a count of zero is
+* the normal state between tests.
+*
+* Synthetic datasets are the exception, and are freed when
+* their last user releases them.
+*
+* Each file is kept once per load order, so tests run in one
+* order never see the features of another.
+*
+* The geometries are shared, so users must not modify or free
+* them. The threaded test versions keep loading their own copies
+* with read_data_file_r(), one per context.
+*/
+
+typedef struct {
+    char* file_name;
+    int order;
+    GEOSGeometryList geoms;
+    uint32_t refcount;
+    double load_time;
+    int64_t bytes;
+} gp_dataset;
+
+/* Each dataset is its own allocation, so the lists handed out never move */
+static gp_dataset** datasets = NULL;
+static size_t ndatasets = 0;
+static size_t capacity = 0;
+static gp_dataset_stats stats;
+
+static gp_dataset*
+dataset_find(const char* file_name)
+{
+    size_t i;
+    for (i = 0; i < ndatasets; i++)
+    {
+        if (datasets[i]->order == order_get() &&
+            strcmp(datasets[i]->file_name, file_name) == 0)
+            return datasets[i];
+    }
+    return NULL;
+}
+
+const GEOSGeometryList*
+dataset_acquire(const char* file_name)
+{
+    gp_dataset* dataset = dataset_find(file_name);
+    stats.acquires++;
+
+    if (dataset)
+    {
+        stats.shared++;
+        stats.saved_time += dataset->load_time;
+        debug_stderr(1, "DATASET [%s] shared, saved %0.3gs\n", file_name, dataset->load_time);
+    }
+    else
+    {
+        double start;
+        int64_t heap;
+        int rv;
+        if (ndatasets >= capacity)
+        {
+            capacity = capacity ? 2 * capacity : 8;
+            datasets = realloc(datasets, sizeof(gp_dataset*) * capacity);
+        }
+        dataset = calloc(1, sizeof(gp_dataset));
+        dataset->file_name = strdup(file_name);
+        dataset->order = order_get();
+        geomlist_init(&dataset->geoms);
+
+        heap = heap_in_use();
+        start = seconds_now();
+        rv = read_data_file(file_name, &dataset->geoms);
+        dataset->load_time = seconds_now() - start;
+        dataset->bytes = heap_in_use() - heap;
+
+        /* A failed load is not kept, the next acquire tries again */
+        if (rv != 0)
+        {
+            geomlist_free(&dataset->geoms);
+            free(dataset->file_name);
+            free(dataset);
+            skip_report("cannot load %s", file_name);
+            return NULL;
+        }
+        datasets[ndatasets++] = dataset;
+
+        stats.datasets++;
+        stats.load_time += dataset->load_time;
+        stats.bytes += dataset->bytes;
+        debug_stderr(1, "DATASET [%s] loaded %zu geometries in %0.3gs, %lld bytes\n",
+            file_name, geomlist_size(&dataset->geoms), dataset->load_time,
+            (long long)dataset->bytes);
+    }
+
+    dataset->refcount++;
+    return &dataset->geoms;
+}
+
+void
+dataset_release(const GEOSGeometryList* geoms)
+{
+    size_t i;
+    for (i = 0; i < ndatasets; i++)
+    {
+        gp_dataset* dataset = datasets[i];
+        if (&dataset->geoms != geoms || dataset->refcount == 0)
+            continue;
+        /*
+        * Synthetic datasets are usually swept over sizes, so
+        * they go as soon as they are unused, rather than piling
+        * up until exit.
+        */
+        if (--dataset->refcount == 0 && synthetic_is_name(dataset->file_name))
+        {
+            stats.bytes -= dataset->bytes;
+            geomlist_free(&dataset->geoms);
+            free(dataset->file_name);
+            free(dataset);
+            datasets[i] = datasets[--ndatasets];
+        }
+        return;
+    }
+}
+
+int
+dataset_clone(const char* file_name, GEOSGeometryList* geoms)
+{
+    size_t i;
+    const GEOSGeometryList* dataset = dataset_acquire(file_name);
+    if (!dataset)
+        return -1;
+    for (i = 0; i < geomlist_size(dataset); i++)
+        geomlist_push(geoms, GEOSGeom_clone(geomlist_get(dataset, i)));
+    dataset_release(dataset);
+    return 0;
+}
+
+void
+dataset_free_all(void)
+{
+    size_t i;
+    for (i = 0; i < ndatasets; i++)
+    {
+        if (datasets[i]->refcount > 0)
+            debug_stderr(1, "DATASET [%s] still has %u users\n",
+                datasets[i]->file_name, datasets[i]->refcount);
+        geomlist_free(&datasets[i]->geoms);
+        free(datasets[i]->file_name);
+        free(datasets[i]);
+    }
+    free(datasets);
+    datasets = NULL;
+    ndatasets = capacity = 0;
+}
+
+void
+dataset_stats(gp_dataset_stats* s)
+{
+    *s = stats;
+}
@@ -0,0 +1,141 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/utsname.h>
+#include <zlib.h>
+
+#include "geos_perf.h"
+
+/************************************************************************
+* Environment of a run.
+*
+* Everything that can make the same test run at a different speed
+* on another machine: the CPU and how many cores it has, the
+* frequency governor, the kernel, the compiler and build type of
+* the runner, the GEOS version, and checksums of the data files
+* the tests used. Values that cannot be read are reported as
+* "unknown".
+*/
+
+#define UNKNOWN "unknown"
+
+/* Copy the first line of a small file, without its newline */
+static void
+read_first_line(const char* file_name, char* buf, size_t buflen)
+{
+    FILE* file = fopen(file_name, "r");
+    snprintf(buf, buflen, "%s", UNKNOWN);
+    if (!file)
+        return;
+    if (fgets(buf, (int)buflen, file))
+        buf[strcspn(buf, "\n")] = '\0';
+    fclose(file);
+}
+
+/* The "model name" line of /proc/cpuinfo, on Linux */
+static void
+read_cpu_model(char* buf, size_t buflen)
+{
+    char line[MAXSTRLEN];
+    FILE* file = fopen("/proc/cpuinfo", "r");
+    snprintf(buf, buflen, "%s", UNKNOWN);
+    if (!file)
+        return;
+    while (fgets(line, sizeof(line), file))
+    {
+        char* colon = strchr(line, ':');
+        if (strncmp(line, "model name", 10) != 0 || !colon)
+            continue;
+        colon++;
+        while (*colon == ' ' || *colon == '\t')
+            colon++;
+        colon[strcspn(colon, "\n")] = '\0';
+        snprintf(buf, buflen, "%s", colon);
+        break;
+    }
+    fclose(file);
+}
+
+int
+checksum_file(const char* file_name, uint32_t* crc, uint64_t* bytes)
+{
+    unsigned char buf[65536];
+    size_t n;
+    uLong c = crc32(0L, Z_NULL, 0);
+    FILE* file = fopen(file_name, "rb");
+    if (!file)
+        return 0;
+    *bytes = 0;
+    while ((n = fread(buf, 1, sizeof(buf), file)) > 0)
+    {
+        c = crc32(c, buf, (uInt)n);
+        *bytes += n;
+    }
+    fclose(file);
+    *crc = (uint32_t)c;
+    return 1;
+}
+
+static int
+dataset_cmp(const void* a, const void* b)
+{
+    return strcmp(((const gp_dataset_checksum*)a)->name,
+                  ((const gp_dataset_checksum*)b)->name);
+}
+
+/* Checksums of the data files the tests used, sorted by name */
+void
+environment_datasets(gp_environment* env)
+{
+    env->ndatasets = data_checksums(&env->datasets);
+    if (env->ndatasets > 1)
+        qsort(env->datasets, env->ndatasets, sizeof(gp_dataset_checksum), dataset_cmp);
+}
+
+void
+environment_collect(gp_environment* env)
+{
+    struct utsname uts;
+    time_t now = time(NULL);
+
+    memset(env, 0, sizeof(gp_environment));
+
+    if (gethostname(env->hostname, MAXSTRLEN) != 0)
+        snprintf(env->hostname, MAXSTRLEN, "%s", UNKNOWN);
+    env->hostname[MAXSTRLEN - 1] = '\0';
+
+    read_cpu_model(env->cpu_model, MAXSTRLEN);
+    env->cores = sysconf(_SC_NPROCESSORS_ONLN);
+    read_first_line("/sys/devices/system/cpu/cpu0/cpufreq/scaling_governor",
+                    env->governor, MAXSTRLEN);
+
+    if (uname(&uts) == 0)
+        snprintf(env->kernel, MAXSTRLEN, "%s %s %s", uts.sysname, uts.release, uts.machine);
+    else
+        snprintf(env->kernel, MAXSTRLEN, "%s", UNKNOWN);
+
+#if defined(__clang__)
+    env->compiler = "clang " __clang_version__;
+#elif defined(__GNUC__)
+    env->compiler = "gcc " __VERSION__;
+#else
+    env->compiler = UNKNOWN;
+#endif
+    env->build_type = BUILD_TYPE[0] ? BUILD_TYPE : "none";
+    env->geos_version = GEOSversion();
+
+    strftime(env->timestamp, MAXSTRLEN, "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+}
+
+void
+environment_free(gp_environment* env)
+{
+    size_t i;
+    for (i = 0; i < env->ndatasets; i++)
+        free(env->datasets[i].name);
+    free(env->datasets);
+    env->datasets = NULL;
+    env->ndatasets = 0;
+}
@@ -0,0 +1,382 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "geos_perf.h"
+
+/************************************************************************
+* Data directories and the dataset manifest.
+*
+* Data files are looked up in the directories given with
+* --data-dir, in order, and then in the data directory of the
+* source tree, so large files can live in a local store outside
+* the repository. Nothing is read until a test needs a file.
+*
+* Each directory can hold a manifest.txt listing the files that
+* belong there, one per line:
+*
+*   name  bytes  crc32  features  vertices
+*
+* with '-' for values that are not known, and '#' comments. The
+* runner checks a test's files against the manifest before its
+* setup: tests whose files are missing are skipped, and files
+* whose size or checksum differs from the manifest are reported,
+* since their results can't be compared with anyone else's.
+* The feature and vertex counts go into the results. Counts of
+* files the manifest doesn't cover, such as synthetic datasets,
+* are taken when the file is loaded.
+*/
+
+#define MAX_DATA_DIRS 8
+#define MANIFEST_FILE "manifest.txt"
+
+typedef struct {
+    char* name;
+    uint64_t bytes;
+    uint32_t crc32;
+    uint64_t features;
+    uint64_t vertices;
+    int has_checksum;
+    int has_counts;
+    int listed;
+    int status;
+    int used;
+} gp_data_entry;
+
+static const char* data_dirs[MAX_DATA_DIRS] = {DATA_DIR};
+static size_t ndata_dirs = 1;
+
+static gp_data_entry* entries = NULL;
+static size_t nentries = 0;
+static size_t capacity = 0;
+static int manifest_loaded = 0;
+
+int
+data_dir_add(const char* dir)
+{
+    if (ndata_dirs >= MAX_DATA_DIRS)
+        return 0;
+    /* The source tree directory stays last */
+    data_dirs[ndata_dirs] = data_dirs[ndata_dirs - 1];
+    data_dirs[ndata_dirs - 1] = dir;
+    ndata_dirs++;
+    return 1;
+}
+
+size_t
+data_dirs_get(const char*** dirs)
+{
+    *dirs = data_dirs;
+    return ndata_dirs;
+}
+
+int
+data_path(const char* file_name, char* path, size_t len)
+{
+    size_t i;
+    struct stat st;
+    for (i = 0; i < ndata_dirs; i++)
+    {
+        snprintf(path, len, "%s/%s", data_dirs[i], file_name);
+        if (stat(path, &st) == 0 && S_ISREG(st.st_mode))
+            return 1;
+    }
+    /* Not found, point at the source tree so errors name a path */
+    snprintf(path, len, "%s/%s", data_dirs[ndata_dirs - 1], file_name);
+    return 0;
+}
+
+static gp_data_entry*
+entry_find(const char* file_name)
+{
+    size_t i;
+    for (i = 0; i < nentries; i++)
+    {
+        if (strcmp(entries[i].name, file_name) == 0)
+            return entries + i;
+    }
+    return NULL;
+}
+
+static gp_data_entry*
+entry_add(const char* file_name)
+{
+    gp_data_entry* entry;
+    if (nentries >= capacity)
+    {
+        capacity = capacity ? 2 * capacity : 32;
+        entries = realloc(entries, sizeof(gp_data_entry) * capacity);
+    }
+    entry = entries + nentries++;
+    memset(entry, 0, sizeof(gp_data_entry));
+    entry->name = strdup(file_name);
+    entry->status = -1;
+    return entry;
+}
+
+/* Parse a manifest value, or '-' for unknown */
+static int
+manifest_value(const char* s, int base, uint64_t* value)
+{
+    char* end;
+    if (strcmp(s, "-") == 0)
+        return 0;
+    *value = strtoull(s, &end, base);
+    return *end == '\0';
+}
+
+static void
+manifest_read(const char* dir)
+{
+    char file_name[MAXSTRLEN];
+    char line[MAXSTRLEN];
+    FILE* file;
+
+    snprintf(file_name, MAXSTRLEN, "%s/%s", dir, MANIFEST_FILE);
+    file = fopen(file_name, "r");
+    if (!file)
+        return;
+    while (fgets(line, sizeof(line), file))
+    {
+        char name[MAXSTRLEN], bytes[64], crc[64], features[64], vertices[64];
+        uint64_t crc32 = 0;
+        gp_data_entry* entry;
+        if (line[0] == '#' ||
+            sscanf(line, "%1023s %63s %63s %63s %63s", name, bytes, crc, features, vertices) != 5)
+            continue;
+        /* Earlier directories win */
+        if (entry_find(name))
+            continue;
+        entry = entry_add(name);
+        entry->listed = 1;
+        entry->has_checksum = manifest_value(bytes, 10, &entry->bytes) &&
+                              manifest_value(crc, 16, &crc32);
+        entry->crc32 = (uint32_t)crc32;
+        entry->has_counts = manifest_value(features, 10, &entry->features) &&
+                            manifest_value(vertices, 10, &entry->vertices);
+    }
+    fclose(file);
+}
+
+static void
+manifest_load(void)
+{
+    size_t i;
+    if (manifest_loaded)
+        return;
+    for (i = 0; i < ndata_dirs; i++)
+        manifest_read(data_dirs[i]);
+    manifest_loaded = 1;
+}
+
+int
+data_check(const char* file_name)
+{
+    char path[MAXSTRLEN];
+    gp_data_entry* entry;
+    uint32_t crc;
+    uint64_t bytes;
+
+    if (synthetic_is_name(file_name))
+        return GP_DATA_OK;
+
+    manifest_load();
+    entry = entry_find(file_name);
+    if (!entry)
+        entry = entry_add(file_name);
+    if (entry->status >= 0)
+        return entry->status;
+
+    if (!data_path(file_name, path, sizeof(path)))
+    {
+        entry->status = GP_DATA_MISSING;
+    }
+    else if (entry->has_checksum && !checksum_file(path, &crc, &bytes))
+    {
+        /* Found but unreadable, the manifest values stay as they are */
+        fprintf(stderr, "cannot read data file '%s': %s\n", path, strerror(errno));
+        entry->status = GP_DATA_MISSING;
+    }
+    else if (entry->has_checksum && (crc != entry->crc32 || bytes != entry->bytes))
+    {
+        fprintf(stderr, "data file '%s' does not match the manifest: %llu bytes, crc32 %08x, expected %llu bytes, crc32 %08x\n",
+                path, (unsigned long long)bytes, crc,
+                (unsigned long long)entry->bytes, entry->crc32);
+        /* The results come from the file as it is */
+        entry->crc32 = crc;
+        entry->bytes = bytes;
+        entry->status = GP_DATA_MISMATCH;
+    }
+    else
+    {
+        if (!entry->listed)
+            debug_stderr(1, "DATA [%s] not in the manifest\n", file_name);
+        entry->status = GP_DATA_OK;
+    }
+    entry->used = entry->status != GP_DATA_MISSING;
+    return entry->status;
+}
+
+/*
+* Checksums of the files the tests used, taken from the check
+* against the manifest, or read now for files it doesn't cover.
+*/
+size_t
+data_checksums(gp_dataset_checksum** checksums)
+{
+    size_t i, n = 0;
+    *checksums = malloc(sizeof(gp_dataset_checksum) * (nentries + 1));
+    for (i = 0; i < nentries; i++)
+    {
+        gp_dataset_checksum* checksum = *checksums + n;
+        char path[MAXSTRLEN];
+        if (!entries[i].used)
+            continue;
+        if (entries[i].has_checksum)
+        {
+            checksum->crc32 = entries[i].crc32;
+            checksum->bytes = entries[i].bytes;
+        }
+        else if (!data_path(entries[i].name, path, sizeof(path)) ||
+                 !checksum_file(path, &checksum->crc32, &checksum->bytes))
+        {
+            continue;
+        }
+        checksum->name = strdup(entries[i].name);
+        n++;
+    }
+    return n;
+}
+
+int
+data_counts(const char* file_name, uint64_t* features, uint64_t* vertices)
+{
+    gp_data_entry* entry;
+    manifest_load();
+    entry = entry_find(file_name);
+    if (!entry || !entry->has_counts)
+        return 0;
+    *features = entry->features;
+    *vertices = entry->vertices;
+    return 1;
+}
+
+int
+data_counts_known(const char* file_name)
+{
+    gp_data_entry* entry;
+    manifest_load();
+    entry = entry_find(file_name);
+    return entry && entry->has_counts;
+}
+
+void
+data_counts_note(const char* file_name, uint64_t features, uint64_t vertices)
+{
+    gp_data_entry* entry;
+    manifest_load();
+    entry = entry_find(file_name);
+    if (!entry)
+        entry = entry_add(file_name);
+    if (entry->has_counts)
+        return;
+    entry->features = features;
+    entry->vertices = vertices;
+    entry->has_counts = 1;
+}
+
+void
+data_free(void)
+{
+    size_t i;
+    for (i = 0; i < nentries; i++)
+        free(entries[i].name);
+    free(entries);
+    entries = NULL;
+    nentries = capacity = 0;
+    manifest_loaded = 0;
+}
+
+static int
+cmp_entry_name(const void* a, const void* b)
+{
+    return strcmp(((const gp_data_entry*)a)->name, ((const gp_data_entry*)b)->name);
+}
+
+/* Add every gzipped data file of a directory to the entries */
+static void
+manifest_scan(const char* dir_name)
+{
+    struct dirent* dirent;
+    DIR* dir = opendir(dir_name);
+    if (!dir)
+        return;
+    while ((dirent = readdir(dir)) != NULL)
+    {
+        size_t len = strlen(dirent->d_name);
+        if (len > 3 && strcmp(dirent->d_name + len - 3, ".gz") == 0 && !entry_find(dirent->d_name))
+            entry_add(dirent->d_name);
+    }
+    closedir(dir);
+}
+
+int
+manifest_write(FILE* out)
+{
+    size_t i, j;
+    manifest_load();
+    for (i = 0; i < ndata_dirs; i++)
+        manifest_scan(data_dirs[i]);
+    qsort(entries, nentries, sizeof(gp_data_entry), cmp_entry_name);
+
+    fprintf(out,
+        "# Data files of the performance tests, checked before each test\n"
+        "# runs. Written by geos_perf --write-manifest. Files that are not\n"
+        "# in the repository, for a --data-dir store, have '-' for values\n"
+        "# that are not known.\n"
+        "#\n"
+        "# name  bytes  crc32  features  vertices\n");
+    for (i = 0; i < nentries; i++)
+    {
+        gp_data_entry* entry = entries + i;
+        char path[MAXSTRLEN];
+        uint32_t crc;
+        uint64_t bytes, vertices = 0;
+        GEOSGeometryList geoms;
+
+        /* Files we don't have keep what the manifest says */
+        if (!data_path(entry->name, path, sizeof(path)) || !checksum_file(path, &crc, &bytes))
+        {
+            if (!entry->listed)
+                continue;
+            fprintf(out, "%s  ", entry->name);
+            if (entry->has_checksum)
+                fprintf(out, "%llu  %08x  ", (unsigned long long)entry->bytes, entry->crc32);
+            else
+                fprintf(out, "-  -  ");
+            if (entry->has_counts)
+                fprintf(out, "%llu  %llu\n", (unsigned long long)entry->features,
+                        (unsigned long long)entry->vertices);
+            else
+                fprintf(out, "-  -\n");
+            continue;
+        }
+
+        geomlist_init(&geoms);
+        if (read_data_file(entry->name, &geoms) != 0)
+        {
+            geomlist_free(&geoms);
+            return 0;
+        }
+        for (j = 0; j < geomlist_size(&geoms); j++)
+            vertices += GEOSGetNumCoordinates(geomlist_get(&geoms, j));
+        fprintf(out, "%s  %llu  %08x  %zu  %llu\n", entry->name,
+                (unsigned long long)bytes, crc, geomlist_size(&geoms),
+                (unsigned long long)vertices);
+        geomlist_free(&geoms);
+    }
+    return 1;
+}
@@ -0,0 +1,226 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/resource.h>
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include "geos_perf.h"
+
+/************************************************************************
+* Allocation tracker.
+*
+* On glibc the executable interposes malloc and friends, and
+* since the executable comes first in symbol resolution, every
+* allocation GEOS makes (operator new ends up in malloc) passes
+* through here. When tracking is off the wrappers only add a
+* branch. Tracking is switched on by the runner around each call
+* to a test's run function. Some run functions start threads of
+* their own, like the partitioned join, so the counters are
+* updated with relaxed atomics and count every thread's
+* allocations. The peak is the peak of the process-wide live
+* bytes, whichever thread made them live.
+*
+* Sizes are measured with malloc_usable_size() on both allocation
+* and release, so live bytes balance even though the requested
+* size of a block is not known when it is freed.
+*/
+
+static int tracking = 0;
+static gp_alloc_stats alloc_stats;
+static int64_t live_bytes = 0;
+
+#ifdef __GLIBC__
+
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t nmemb, size_t size);
+extern void* __libc_realloc(void* ptr, size_t size);
+extern void* __libc_memalign(size_t alignment, size_t size);
+extern void __libc_free(void* ptr);
+
+static inline int
+tracking_on(void)
+{
+    return __atomic_load_n(&tracking, __ATOMIC_RELAXED);
+}
+
+static inline void
+track_live(int64_t delta)
+{
+    int64_t live, peak;
+    live = __atomic_add_fetch(&live_bytes, delta, __ATOMIC_RELAXED);
+    peak = __atomic_load_n(&alloc_stats.peak_live_bytes, __ATOMIC_RELAXED);
+    while (live > peak &&
+           !__atomic_compare_exchange_n(&alloc_stats.peak_live_bytes, &peak, live,
+                                        1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+static inline void
+track_alloc(void* ptr, size_t size)
+{
+    __atomic_fetch_add(&alloc_stats.allocs, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&alloc_stats.bytes, size, __ATOMIC_RELAXED);
+    track_live((int64_t)malloc_usable_size(ptr));
+}
+
+static inline void
+track_free(void* ptr)
+{
+    __atomic_fetch_add(&alloc_stats.frees, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_sub(&live_bytes, (int64_t)malloc_usable_size(ptr), __ATOMIC_RELAXED);
+}
+
+void*
+malloc(size_t size)
+{
+    void* ptr = __libc_malloc(size);
+    if (tracking_on() && ptr)
+        track_alloc(ptr, size);
+    return ptr;
+}
+
+void*
+calloc(size_t nmemb, size_t size)
+{
+    void* ptr = __libc_calloc(nmemb, size);
+    if (tracking_on() && ptr)
+        track_alloc(ptr, nmemb * size);
+    return ptr;
+}
+
+/*
+* A realloc is one allocation of the bytes it grows the block by,
+* not a free and a new allocation, so growing vectors don't count
+* double. Shrinking counts as an allocation of no bytes.
+*/
+void*
+realloc(void* ptr, size_t size)
+{
+    void* newptr;
+    size_t old_size;
+    if (!ptr)
+        return malloc(size);
+    old_size = malloc_usable_size(ptr);
+    newptr = __libc_realloc(ptr, size);
+    if (!tracking_on())
+        return newptr;
+    if (newptr)
+    {
+        __atomic_fetch_add(&alloc_stats.allocs, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&alloc_stats.bytes, size > old_size ? size - old_size : 0, __ATOMIC_RELAXED);
+        track_live((int64_t)malloc_usable_size(newptr) - (int64_t)old_size);
+    }
+    else if (size == 0)
+    {
+        /* glibc frees the block on a realloc to zero */
+        __atomic_fetch_add(&alloc_stats.frees, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_sub(&live_bytes, (int64_t)old_size, __ATOMIC_RELAXED);
+    }
+    return newptr;
+}
+
+void*
+memalign(size_t alignment, size_t size)
+{
+    void* ptr = __libc_memalign(alignment, size);
+    if (tracking_on() && ptr)
+        track_alloc(ptr, size);
+    return ptr;
+}
+
+void*
+aligned_alloc(size_t alignment, size_t size)
+{
+    return memalign(alignment, size);
+}
+
+int
+posix_memalign(void** memptr, size_t alignment, size_t size)
+{
+    void* ptr;
+    if (alignment < sizeof(void*) || (alignment & (alignment - 1)) != 0)
+        return EINVAL;
+    ptr = memalign(alignment, size);
+    if (!ptr)
+        return ENOMEM;
+    *memptr = ptr;
+    return 0;
+}
+
+void
+free(void* ptr)
+{
+    if (tracking_on() && ptr)
+        track_free(ptr);
+    __libc_free(ptr);
+}
+
+int
+alloc_tracking_available(void)
+{
+    return 1;
+}
+
+#else
+
+int
+alloc_tracking_available(void)
+{
+    return 0;
+}
+
+#endif
+
+void
+alloc_tracking_reset(void)
+{
+    memset(&alloc_stats, 0, sizeof(alloc_stats));
+    live_bytes = 0;
+}
+
+void
+alloc_tracking_start(void)
+{
+    __atomic_store_n(&tracking, 1, __ATOMIC_RELAXED);
+}
+
+void
+alloc_tracking_stop(void)
+{
+    __atomic_store_n(&tracking, 0, __ATOMIC_RELAXED);
+}
+
+void
+alloc_tracking_read(gp_alloc_stats* stats)
+{
+    *stats = alloc_stats;
+}
+
+/*
+* High-water mark of the resident set size, in kilobytes on
+* Linux (and in bytes on MacOS).
+*/
+long
+peak_rss(void)
+{
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+    return usage.ru_maxrss;
+}
+
+/* Bytes of heap in use, where the allocator can tell us */
+int64_t
+heap_in_use(void)
+{
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 33)
+    struct mallinfo2 info = mallinfo2();
+    return (int64_t)info.uordblks + (int64_t)info.hblkhd;
+#else
+    return 0;
+#endif
+}
@@ -0,0 +1,251 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "geos_perf.h"
+
+/************************************************************************
+* Dataset ordering.
+*
+* Data files list their features in whatever order the source
+* used, and the tests walk them in that order. Reordering them
+* along a space-filling curve puts features that are near each
+* other in space near each other in the list, and shuffling
+* takes away whatever locality the file had, so running a test
+* on each order shows how much the input order costs.
+*
+* The order is applied as each data file is loaded. Features are
+* sorted by the Hilbert or Morton code of their envelope centers,
+* within the extent of all the centers, and are then cloned in
+* their new order. The clones are allocated one after another,
+* so the heap layout follows the new order as well as the list.
+*/
+
+/* Bits per ordinate of the curve codes, the most GEOSHilbertCode takes */
+#define ORDER_LEVEL 16
+#define ORDER_SHUFFLE_SEED 1
+
+static const char* order_names[GP_ORDER_COUNT] = {
+    "original", "hilbert", "morton", "shuffle"
+};
+
+static int order = GP_ORDER_ORIGINAL;
+
+typedef struct {
+    uint64_t key;
+    size_t index;
+} gp_order_key;
+
+int
+order_parse(const char* name)
+{
+    int i;
+    for (i = 0; i < GP_ORDER_COUNT; i++)
+    {
+        if (strcmp(name, order_names[i]) == 0)
+            return i;
+    }
+    return -1;
+}
+
+int
+order_set(const char* name)
+{
+    int i = order_parse(name);
+    if (i < 0)
+        return 0;
+    order = i;
+    return 1;
+}
+
+int
+order_get(void)
+{
+    return order;
+}
+
+const char*
+order_name(int i)
+{
+    return i >= 0 && i < GP_ORDER_COUNT ? order_names[i] : "unknown";
+}
+
+/* Spread the low 16 bits of x out to the even bits */
+static uint64_t
+morton_spread(uint32_t x)
+{
+    uint64_t v = x & 0xFFFF;
+    v = (v | (v << 8)) & 0x00FF00FF;
+    v = (v | (v << 4)) & 0x0F0F0F0F;
+    v = (v | (v << 2)) & 0x33333333;
+    v = (v | (v << 1)) & 0x55555555;
+    return v;
+}
+
+static uint64_t
+morton_code(uint32_t x, uint32_t y)
+{
+    return morton_spread(x) | (morton_spread(y) << 1);
+}
+
+/*
+* Distance along the Hilbert curve of a cell of a 2^level grid,
+* rotating the quadrant at each level.
+*/
+static uint64_t
+hilbert_code(uint32_t x, uint32_t y, int level)
+{
+    uint32_t s, rx, ry, t;
+    uint64_t d = 0;
+    for (s = 1u << (level - 1); s > 0; s >>= 1)
+    {
+        rx = (x & s) > 0;
+        ry = (y & s) > 0;
+        d += (uint64_t)s * s * ((3 * rx) ^ ry);
+        if (ry == 0)
+        {
+            if (rx == 1)
+            {
+                x = s - 1 - (x & (s - 1));
+                y = s - 1 - (y & (s - 1));
+            }
+            t = x;
+            x = y;
+            y = t;
+        }
+        x &= s - 1;
+        y &= s - 1;
+    }
+    return d;
+}
+
+static int
+cmp_order_key(const void* a, const void* b)
+{
+    const gp_order_key* ka = (const gp_order_key*)a;
+    const gp_order_key* kb = (const gp_order_key*)b;
+    if (ka->key != kb->key)
+        return ka->key < kb->key ? -1 : 1;
+    return (ka->index > kb->index) - (ka->index < kb->index);
+}
+
+static int
+envelope_center(GEOSContextHandle_t ctx, const GEOSGeometry* g, double* x, double* y)
+{
+    double xmin, ymin, xmax, ymax;
+    if (GEOSisEmpty_r(ctx, g) || !geom_extent_r(ctx, g, &xmin, &ymin, &xmax, &ymax))
+        return 0;
+    *x = (xmin + xmax) / 2.0;
+    *y = (ymin + ymax) / 2.0;
+    return 1;
+}
+
+/* Curve keys of the envelope centers, empties first */
+static void
+order_curve_keys(GEOSContextHandle_t ctx, const GEOSGeometryList* geoms, size_t begin,
+                 gp_order_key* keys, size_t n)
+{
+    size_t i;
+    double xmin = 0, ymin = 0, xmax = 0, ymax = 0, sx, sy;
+    double* xy = malloc(sizeof(double) * 2 * n);
+    char* valid = malloc(n);
+    int first = 1;
+    uint32_t cells = (1u << ORDER_LEVEL) - 1;
+#if GEOS_VERSION_CMP >= 311
+    GEOSGeometry* extent = NULL;
+#endif
+
+    for (i = 0; i < n; i++)
+    {
+        valid[i] = envelope_center(ctx, geomlist_get(geoms, begin + i), xy + 2 * i, xy + 2 * i + 1);
+        if (!valid[i])
+            continue;
+        if (first || xy[2 * i] < xmin) xmin = xy[2 * i];
+        if (first || xy[2 * i] > xmax) xmax = xy[2 * i];
+        if (first || xy[2 * i + 1] < ymin) ymin = xy[2 * i + 1];
+        if (first || xy[2 * i + 1] > ymax) ymax = xy[2 * i + 1];
+        first = 0;
+    }
+    sx = xmax > xmin ? cells / (xmax - xmin) : 0.0;
+    sy = ymax > ymin ? cells / (ymax - ymin) : 0.0;
+
+#if GEOS_VERSION_CMP >= 311
+    if (order == GP_ORDER_HILBERT && xmax > xmin && ymax > ymin)
+        extent = GEOSGeom_createRectangle_r(ctx, xmin, ymin, xmax, ymax);
+#endif
+
+    for (i = 0; i < n; i++)
+    {
+        uint32_t cx, cy;
+        keys[i].index = begin + i;
+        keys[i].key = 0;
+        if (!valid[i])
+            continue;
+#if GEOS_VERSION_CMP >= 311
+        if (extent)
+        {
+            unsigned int code = 0;
+            GEOSHilbertCode_r(ctx, geomlist_get(geoms, begin + i), extent, ORDER_LEVEL, &code);
+            keys[i].key = (uint64_t)code + 1;
+            continue;
+        }
+#endif
+        cx = (uint32_t)((xy[2 * i] - xmin) * sx);
+        cy = (uint32_t)((xy[2 * i + 1] - ymin) * sy);
+        keys[i].key = 1 + (order == GP_ORDER_HILBERT ?
+                           hilbert_code(cx, cy, ORDER_LEVEL) :
+                           morton_code(cx, cy));
+    }
+
+#if GEOS_VERSION_CMP >= 311
+    if (extent)
+        GEOSGeom_destroy_r(ctx, extent);
+#endif
+    free(valid);
+    free(xy);
+}
+
+void
+order_apply(GEOSContextHandle_t ctx, GEOSGeometryList* geoms, size_t begin)
+{
+    size_t i, n = geomlist_size(geoms) - begin;
+    gp_order_key* keys;
+    GEOSGeometry** ordered;
+    GEOSContextHandle_t handle;
+
+    if (order == GP_ORDER_ORIGINAL || geomlist_size(geoms) < begin + 2)
+        return;
+
+    /* Geometries are not tied to the context that made them */
+    handle = ctx ? ctx : GEOS_init_r();
+    keys = malloc(sizeof(gp_order_key) * n);
+
+    if (order == GP_ORDER_SHUFFLE)
+    {
+        uint64_t rng = ORDER_SHUFFLE_SEED;
+        for (i = 0; i < n; i++)
+        {
+            keys[i].index = begin + i;
+            keys[i].key = random_next(&rng);
+        }
+    }
+    else
+    {
+        order_curve_keys(handle, geoms, begin, keys, n);
+    }
+    qsort(keys, n, sizeof(gp_order_key), cmp_order_key);
+
+    ordered = malloc(sizeof(GEOSGeometry*) * n);
+    for (i = 0; i < n; i++)
+        ordered[i] = GEOSGeom_clone_r(handle, geoms->geoms[keys[i].index]);
+    for (i = 0; i < n; i++)
+    {
+        GEOSGeom_destroy_r(handle, geoms->geoms[begin + i]);
+        geoms->geoms[begin + i] = ordered[i];
+    }
+
+    free(ordered);
+    free(keys);
+    if (!ctx)
+        GEOS_finish_r(handle);
+}
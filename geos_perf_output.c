@@ -0,0 +1,530 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "geos_perf.h"
+
+/************************************************************************
+* Output formats.
+*
+* The runner hands every result to the selected output, which
+* writes it out straight away, so a crash part way through a run
+* still leaves the earlier results behind.
+*
+* The csv output writes one headerless row per result, so that
+* the rows of several runs can be appended to one file. The json
+* output writes a single document per run, holding the environment
+* and every result with its samples and counters.
+*/
+
+static const gp_output* output = NULL;
+static FILE* output_file = NULL;
+static gp_environment environment;
+
+
+/************************************************************************
+* CSV output
+*/
+
+static void
+csv_begin(FILE* file, const gp_environment* env)
+{
+    return;
+}
+
+static void
+csv_result(FILE* file, const gp_result* result)
+{
+    int phase, counter;
+    uint32_t count = result->count ? result->count : 1;
+    fprintf(file, "%s,%s,%u,%0.5g,%0.5g,%0.5g,%0.5g,%0.5g,%0.5g,%0.5g,%0.5g,%0.5g,%0.5g,%0.5g,%0.5g",
+        result->version,
+        result->name,
+        result->count,
+        result->setup_time,
+        result->run_time,
+        result->cleanup_time,
+        result->stats.min,
+        result->stats.p50,
+        result->stats.p90,
+        result->stats.p99,
+        result->stats.max,
+        result->stats.mean,
+        result->stats.stddev,
+        result->stats.p50_ci_lo,
+        result->stats.p50_ci_hi);
+
+    /* Allocations per iteration, only when tracked */
+    if (result->allocs_valid)
+        fprintf(file, ",%0.5g,%0.5g,%lld",
+            (double)result->allocs.allocs / count,
+            (double)result->allocs.bytes / count,
+            (long long)result->allocs.peak_live_bytes);
+    else
+        fprintf(file, ",,,");
+
+    for (phase = 0; phase < GP_PHASE_COUNT; phase++)
+        fprintf(file, ",%ld", result->rss_delta[phase]);
+
+    /* Counters the kernel did not provide are left empty */
+    for (phase = 0; phase < GP_PHASE_COUNT; phase++)
+    {
+        const gp_counters* counters = &result->counters[phase];
+        for (counter = 0; counter < GP_COUNTER_COUNT; counter++)
+        {
+            if (counters->valid[counter])
+                fprintf(file, ",%llu", (unsigned long long)counters->values[counter]);
+            else
+                fprintf(file, ",");
+        }
+    }
+
+    /* Throughput, only for tests that report their work */
+    if (result->work_items > 0 && result->stats.p50 > 0.0)
+        fprintf(file, ",%0.5g,%0.5g",
+            result->work_items / result->stats.p50,
+            result->work_bytes / result->stats.p50 / 1e6);
+    else
+        fprintf(file, ",,");
+
+    /* Feature and vertex counts of the test's data files */
+    if (result->features > 0)
+        fprintf(file, ",%llu,%llu",
+            (unsigned long long)result->features,
+            (unsigned long long)result->vertices);
+    else
+        fprintf(file, ",,");
+
+    /* Parameters go last, after the legacy columns and the newer ones */
+    fprintf(file, ",%s\n", result->params ? result->params : "");
+}
+
+static void
+csv_throughput(FILE* file, const gp_throughput* result)
+{
+    fprintf(file, "%s,%s,%s,%u,%llu,%0.5g,%0.5g,%0.5g\n",
+        result->version,
+        result->name,
+        result->params ? result->params : "",
+        result->threads,
+        (unsigned long long)result->ops,
+        result->wall_time,
+        result->ops_per_sec,
+        result->efficiency);
+}
+
+static void
+csv_ab(FILE* file, const gp_ab_result* result)
+{
+    fprintf(file, "%s,%s,%s,%s,%s,%u,%0.5g,%0.5g,%0.5g,%0.5g,%0.5g\n",
+        result->path_a,
+        result->version_a,
+        result->path_b,
+        result->version_b,
+        result->name,
+        result->count,
+        result->p50_a,
+        result->p50_b,
+        result->ratio,
+        result->ratio_ci_lo,
+        result->ratio_ci_hi);
+}
+
+static void
+csv_pipeline(FILE* file, const gp_pipeline_result* result)
+{
+    fprintf(file, "%s,pipeline,%s:%g,%s,%u,%llu,%llu,%llu,%llu,%0.5g,%0.5g,%0.5g,%llu,%llu,%llu,%ld,%ld\n",
+        result->version,
+        result->op,
+        result->arg,
+        result->file_name,
+        result->workers,
+        (unsigned long long)result->queue_size,
+        (unsigned long long)result->features,
+        (unsigned long long)result->bytes,
+        (unsigned long long)result->errors,
+        result->wall_time,
+        result->features_per_sec,
+        result->mb_per_sec,
+        (unsigned long long)result->peak_queue,
+        (unsigned long long)result->peak_queue_bytes,
+        (unsigned long long)result->reader_waits,
+        result->peak_rss,
+        result->rss_delta);
+}
+
+static void
+csv_end(FILE* file, const gp_environment* env)
+{
+    return;
+}
+
+
+/************************************************************************
+* JSON output
+*/
+
+/* Separates the entries of the results array */
+static int json_nresults = 0;
+
+static void
+json_string(FILE* file, const char* str)
+{
+    const unsigned char* c;
+    fputc('"', file);
+    for (c = (const unsigned char*)(str ? str : ""); *c; c++)
+    {
+        if (*c == '"' || *c == '\\')
+            fprintf(file, "\\%c", *c);
+        else if (*c == '\n')
+            fputs("\\n", file);
+        else if (*c == '\t')
+            fputs("\\t", file);
+        else if (*c < 0x20)
+            fprintf(file, "\\u%04x", *c);
+        else
+            fputc(*c, file);
+    }
+    fputc('"', file);
+}
+
+/* JSON has no NaN or infinity, write those as null */
+static void
+json_number(FILE* file, double d)
+{
+    if (d != d || d - d != 0.0)
+        fputs("null", file);
+    else
+        fprintf(file, "%.9g", d);
+}
+
+static void
+json_key(FILE* file, const char* key)
+{
+    json_string(file, key);
+    fputs(": ", file);
+}
+
+static void
+json_next_result(FILE* file)
+{
+    fputs(json_nresults++ ? ",\n    {" : "\n    {", file);
+}
+
+static void
+json_begin(FILE* file, const gp_environment* env)
+{
+    json_nresults = 0;
+    fputs("{\n  \"results\": [", file);
+}
+
+static void
+json_result(FILE* file, const gp_result* result)
+{
+    static const char* phase_names[GP_PHASE_COUNT] = {"setup", "run", "cleanup"};
+    static const char* stat_names[] = {"min", "p50", "p90", "p99", "max", "mean", "stddev", "p50_ci_lo", "p50_ci_hi"};
+    double stats[] = {
+        result->stats.min, result->stats.p50, result->stats.p90,
+        result->stats.p99, result->stats.max, result->stats.mean,
+        result->stats.stddev, result->stats.p50_ci_lo, result->stats.p50_ci_hi};
+    int phase, counter, n;
+    uint32_t i;
+
+    json_next_result(file);
+    fputs("\"mode\": \"timing\", ", file);
+    json_key(file, "version"); json_string(file, result->version);
+    fputs(", ", file);
+    json_key(file, "name");    json_string(file, result->name);
+    fputs(", ", file);
+    json_key(file, "params");  json_string(file, result->params);
+    fprintf(file, ",\n      \"warmup\": %u, \"count\": %u", result->warmup, result->count);
+
+    fputs(",\n      \"times\": {", file);
+    json_key(file, "setup");   json_number(file, result->setup_time);
+    fputs(", ", file);
+    json_key(file, "run");     json_number(file, result->run_time);
+    fputs(", ", file);
+    json_key(file, "cleanup"); json_number(file, result->cleanup_time);
+    fputs("}", file);
+
+    fputs(",\n      \"stats\": {", file);
+    for (i = 0; i < sizeof(stats) / sizeof(stats[0]); i++)
+    {
+        fputs(i ? ", " : "", file);
+        json_key(file, stat_names[i]);
+        json_number(file, stats[i]);
+    }
+    fputs("}", file);
+
+    fputs(",\n      \"samples\": [", file);
+    for (i = 0; i < result->count; i++)
+    {
+        fputs(i ? ", " : "", file);
+        json_number(file, result->samples[i]);
+    }
+    fputs("]", file);
+
+    if (result->allocs_valid)
+        fprintf(file, ",\n      \"allocs\": {\"allocs\": %llu, \"frees\": %llu, \"bytes\": %llu, \"peak_live_bytes\": %lld}",
+            (unsigned long long)result->allocs.allocs,
+            (unsigned long long)result->allocs.frees,
+            (unsigned long long)result->allocs.bytes,
+            (long long)result->allocs.peak_live_bytes);
+
+    if (result->load.files > 0)
+    {
+        fprintf(file, ",\n      \"load\": {\"files\": %u, \"cache_hits\": %u, \"threads\": %u, \"geoms\": %llu, ",
+            result->load.files, result->load.cache_hits, result->load.threads,
+            (unsigned long long)result->load.geoms);
+        json_key(file, "wkt_time");   json_number(file, result->load.wkt_time);
+        fputs(", ", file);
+        json_key(file, "cache_time"); json_number(file, result->load.cache_time);
+        fputs("}", file);
+    }
+
+    if (result->work_items > 0)
+    {
+        fprintf(file, ",\n      \"work\": {\"items\": %llu, \"bytes\": %llu, ",
+            (unsigned long long)result->work_items,
+            (unsigned long long)result->work_bytes);
+        json_key(file, "items_per_sec");
+        json_number(file, result->stats.p50 > 0.0 ? result->work_items / result->stats.p50 : 0.0);
+        fputs(", ", file);
+        json_key(file, "mb_per_sec");
+        json_number(file, result->stats.p50 > 0.0 ? result->work_bytes / result->stats.p50 / 1e6 : 0.0);
+        fputs("}", file);
+    }
+
+    if (result->features > 0)
+    {
+        fprintf(file, ",\n      \"data\": {\"features\": %llu, \"vertices\": %llu, ",
+            (unsigned long long)result->features,
+            (unsigned long long)result->vertices);
+        json_key(file, "ns_per_vertex");
+        json_number(file, result->vertices > 0 ? result->stats.p50 * 1e9 / result->vertices : 0.0);
+        fputs("}", file);
+    }
+
+    fputs(",\n      \"rss_delta\": {", file);
+    for (phase = 0; phase < GP_PHASE_COUNT; phase++)
+        fprintf(file, "%s\"%s\": %ld", phase ? ", " : "", phase_names[phase], result->rss_delta[phase]);
+    fputs("}", file);
+
+    /* Counters the kernel did not provide are left out */
+    fputs(",\n      \"counters\": {", file);
+    for (phase = 0; phase < GP_PHASE_COUNT; phase++)
+    {
+        const gp_counters* counters = &result->counters[phase];
+        fprintf(file, "%s\"%s\": {", phase ? ", " : "", phase_names[phase]);
+        for (counter = 0, n = 0; counter < GP_COUNTER_COUNT; counter++)
+        {
+            if (!counters->valid[counter])
+                continue;
+            fprintf(file, "%s\"%s\": %llu", n++ ? ", " : "",
+                counters_name(counter),
+                (unsigned long long)counters->values[counter]);
+        }
+        fputs("}", file);
+    }
+    fputs("}}", file);
+}
+
+static void
+json_throughput(FILE* file, const gp_throughput* result)
+{
+    json_next_result(file);
+    fputs("\"mode\": \"throughput\", ", file);
+    json_key(file, "version"); json_string(file, result->version);
+    fputs(", ", file);
+    json_key(file, "name");    json_string(file, result->name);
+    fputs(", ", file);
+    json_key(file, "params");  json_string(file, result->params);
+    fprintf(file, ",\n      \"threads\": %u, \"ops\": %llu, ",
+        result->threads, (unsigned long long)result->ops);
+    json_key(file, "wall_time");   json_number(file, result->wall_time);
+    fputs(", ", file);
+    json_key(file, "ops_per_sec"); json_number(file, result->ops_per_sec);
+    fputs(", ", file);
+    json_key(file, "efficiency");  json_number(file, result->efficiency);
+    fputs("}", file);
+}
+
+static void
+json_ab(FILE* file, const gp_ab_result* result)
+{
+    json_next_result(file);
+    fputs("\"mode\": \"ab\", ", file);
+    json_key(file, "name");      json_string(file, result->name);
+    fputs(",\n      ", file);
+    json_key(file, "path_a");    json_string(file, result->path_a);
+    fputs(", ", file);
+    json_key(file, "version_a"); json_string(file, result->version_a);
+    fputs(",\n      ", file);
+    json_key(file, "path_b");    json_string(file, result->path_b);
+    fputs(", ", file);
+    json_key(file, "version_b"); json_string(file, result->version_b);
+    fprintf(file, ",\n      \"count\": %u, ", result->count);
+    json_key(file, "p50_a");       json_number(file, result->p50_a);
+    fputs(", ", file);
+    json_key(file, "p50_b");       json_number(file, result->p50_b);
+    fputs(", ", file);
+    json_key(file, "ratio");       json_number(file, result->ratio);
+    fputs(", ", file);
+    json_key(file, "ratio_ci_lo"); json_number(file, result->ratio_ci_lo);
+    fputs(", ", file);
+    json_key(file, "ratio_ci_hi"); json_number(file, result->ratio_ci_hi);
+    fputs("}", file);
+}
+
+static void
+json_pipeline(FILE* file, const gp_pipeline_result* result)
+{
+    json_next_result(file);
+    fputs("\"mode\": \"pipeline\", ", file);
+    json_key(file, "version"); json_string(file, result->version);
+    fputs(", ", file);
+    json_key(file, "op");      json_string(file, result->op);
+    fputs(", ", file);
+    json_key(file, "arg");     json_number(file, result->arg);
+    fputs(", ", file);
+    json_key(file, "file");    json_string(file, result->file_name);
+    fprintf(file, ",\n      \"workers\": %u, \"queue_size\": %llu, \"features\": %llu, \"bytes\": %llu, \"errors\": %llu, ",
+        result->workers,
+        (unsigned long long)result->queue_size,
+        (unsigned long long)result->features,
+        (unsigned long long)result->bytes,
+        (unsigned long long)result->errors);
+    json_key(file, "wall_time");        json_number(file, result->wall_time);
+    fputs(", ", file);
+    json_key(file, "features_per_sec"); json_number(file, result->features_per_sec);
+    fputs(", ", file);
+    json_key(file, "mb_per_sec");       json_number(file, result->mb_per_sec);
+    fprintf(file, ",\n      \"peak_queue\": %llu, \"peak_queue_bytes\": %llu, \"reader_waits\": %llu, \"peak_rss\": %ld, \"rss_delta\": %ld}",
+        (unsigned long long)result->peak_queue,
+        (unsigned long long)result->peak_queue_bytes,
+        (unsigned long long)result->reader_waits,
+        result->peak_rss,
+        result->rss_delta);
+}
+
+/*
+* The environment comes last, so that it can list the data
+* files the tests used.
+*/
+static void
+json_end(FILE* file, const gp_environment* env)
+{
+    size_t i;
+    fputs(json_nresults ? "\n  ],\n" : "],\n", file);
+    fputs("  \"environment\": {\n    ", file);
+    json_key(file, "hostname");      json_string(file, env->hostname);
+    fputs(",\n    ", file);
+    json_key(file, "cpu_model");     json_string(file, env->cpu_model);
+    fprintf(file, ",\n    \"cores\": %ld,\n    ", env->cores);
+    json_key(file, "governor");      json_string(file, env->governor);
+    fputs(",\n    ", file);
+    json_key(file, "kernel");        json_string(file, env->kernel);
+    fputs(",\n    ", file);
+    json_key(file, "compiler");      json_string(file, env->compiler);
+    fputs(",\n    ", file);
+    json_key(file, "build_type");    json_string(file, env->build_type);
+    fputs(",\n    ", file);
+    json_key(file, "geos_version");  json_string(file, env->geos_version);
+    fputs(",\n    ", file);
+    json_key(file, "timestamp");     json_string(file, env->timestamp);
+    fputs(",\n    \"datasets\": [", file);
+    for (i = 0; i < env->ndatasets; i++)
+    {
+        fputs(i ? ",\n      {" : "\n      {", file);
+        json_key(file, "name");
+        json_string(file, env->datasets[i].name);
+        fprintf(file, ", \"crc32\": \"%08x\", \"bytes\": %llu}",
+            env->datasets[i].crc32,
+            (unsigned long long)env->datasets[i].bytes);
+    }
+    fputs(env->ndatasets ? "\n    ]\n  }\n}\n" : "]\n  }\n}\n", file);
+}
+
+
+/************************************************************************
+* Output selection
+*/
+
+static const gp_output outputs[] = {
+    {"csv", csv_begin, csv_result, csv_throughput, csv_ab, csv_pipeline, csv_end},
+    {"json", json_begin, json_result, json_throughput, json_ab, json_pipeline, json_end},
+    {NULL, NULL, NULL, NULL, NULL, NULL, NULL}
+};
+
+int
+output_open(const char* format, const char* file_name)
+{
+    const gp_output* o;
+    for (o = outputs; o->name; o++)
+    {
+        if (strcmp(o->name, format) == 0)
+            break;
+    }
+    if (!o->name)
+    {
+        fprintf(stderr, "unknown output format '%s'\n", format);
+        return 0;
+    }
+
+    output_file = file_name ? fopen(file_name, "w") : stdout;
+    if (!output_file)
+    {
+        fprintf(stderr, "unable to open '%s' for writing\n", file_name);
+        return 0;
+    }
+    output = o;
+
+    environment_collect(&environment);
+    output->begin(output_file, &environment);
+    fflush(output_file);
+    return 1;
+}
+
+void
+output_result(const gp_result* result)
+{
+    output->result(output_file, result);
+    fflush(output_file);
+}
+
+void
+output_throughput(const gp_throughput* result)
+{
+    output->throughput(output_file, result);
+    fflush(output_file);
+}
+
+void
+output_ab(const gp_ab_result* result)
+{
+    output->ab(output_file, result);
+    fflush(output_file);
+}
+
+void
+output_pipeline(const gp_pipeline_result* result)
+{
+    output->pipeline(output_file, result);
+    fflush(output_file);
+}
+
+void
+output_close(void)
+{
+    if (!output)
+        return;
+    environment_datasets(&environment);
+    output->end(output_file, &environment);
+    if (output_file != stdout)
+        fclose(output_file);
+    else
+        fflush(output_file);
+    environment_free(&environment);
+    output = NULL;
+    output_file = NULL;
+}
@@ -0,0 +1,365 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "geos_perf.h"
+
+/************************************************************************
+* Streaming pipeline mode.
+*
+* The tests load their whole dataset before timing starts, but
+* batch jobs stream more features than fit in memory. A pipeline
+* run works the same way: a reader thread inflates the data file
+* and copies each line onto a bounded queue, and worker threads,
+* each with its own GEOS context, take lines off the queue, parse
+* them, apply the operation and destroy the input and result
+* straight away. When the queue is full the reader waits, so
+* at most queue_size lines and one geometry per worker are in
+* memory at any time, however large the file.
+*
+* The timed section runs from the start of the reader to the
+* last worker finishing, so it includes inflating and parsing.
+*/
+
+#define PIPELINE_DEFAULT_QUEUE 1024
+
+typedef struct {
+    char** lines;
+    size_t* sizes;
+    size_t capacity;
+    size_t head;
+    size_t count;
+    int done;
+    uint64_t bytes;
+    uint64_t total_bytes;
+    size_t peak_count;
+    uint64_t peak_bytes;
+    uint64_t reader_waits;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+} gp_queue;
+
+typedef int (*gp_pipeline_op_func)(GEOSContextHandle_t ctx, const GEOSGeometry* g, double arg);
+
+typedef struct {
+    const char* name;
+    gp_pipeline_op_func func;
+    double default_arg;
+} gp_pipeline_op;
+
+typedef struct {
+    gp_queue* queue;
+    const gp_pipeline_op* op;
+    double arg;
+    uint64_t features;
+    uint64_t errors;
+} gp_pipeline_worker;
+
+static void
+queue_init(gp_queue* q, size_t capacity)
+{
+    memset(q, 0, sizeof(gp_queue));
+    q->capacity = capacity;
+    q->lines = calloc(capacity, sizeof(char*));
+    q->sizes = calloc(capacity, sizeof(size_t));
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->not_empty, NULL);
+    pthread_cond_init(&q->not_full, NULL);
+}
+
+static void
+queue_free(gp_queue* q)
+{
+    pthread_mutex_destroy(&q->lock);
+    pthread_cond_destroy(&q->not_empty);
+    pthread_cond_destroy(&q->not_full);
+    free(q->lines);
+    free(q->sizes);
+}
+
+/* Takes ownership of line, waiting while the queue is full */
+static void
+queue_push(gp_queue* q, char* line, size_t size)
+{
+    size_t tail;
+    pthread_mutex_lock(&q->lock);
+    if (q->count == q->capacity)
+        q->reader_waits++;
+    while (q->count == q->capacity)
+        pthread_cond_wait(&q->not_full, &q->lock);
+    tail = (q->head + q->count) % q->capacity;
+    q->lines[tail] = line;
+    q->sizes[tail] = size;
+    q->count++;
+    q->bytes += size;
+    q->total_bytes += size;
+    if (q->count > q->peak_count)
+        q->peak_count = q->count;
+    if (q->bytes > q->peak_bytes)
+        q->peak_bytes = q->bytes;
+    pthread_cond_signal(&q->not_empty);
+    pthread_mutex_unlock(&q->lock);
+}
+
+/* Next line, to be freed by the caller, or NULL at the end */
+static char*
+queue_pop(gp_queue* q)
+{
+    char* line = NULL;
+    pthread_mutex_lock(&q->lock);
+    while (q->count == 0 && !q->done)
+        pthread_cond_wait(&q->not_empty, &q->lock);
+    if (q->count > 0)
+    {
+        line = q->lines[q->head];
+        q->bytes -= q->sizes[q->head];
+        q->head = (q->head + 1) % q->capacity;
+        q->count--;
+        pthread_cond_signal(&q->not_full);
+    }
+    pthread_mutex_unlock(&q->lock);
+    return line;
+}
+
+static void
+queue_close(gp_queue* q)
+{
+    pthread_mutex_lock(&q->lock);
+    q->done = 1;
+    pthread_cond_broadcast(&q->not_empty);
+    pthread_mutex_unlock(&q->lock);
+}
+
+
+/************************************************************************
+* Operations, applied to each feature with an optional argument
+*/
+
+static int
+op_parse(GEOSContextHandle_t ctx, const GEOSGeometry* g, double arg)
+{
+    return 1;
+}
+
+static int
+op_isvalid(GEOSContextHandle_t ctx, const GEOSGeometry* g, double arg)
+{
+    return GEOSisValid_r(ctx, g) != 2;
+}
+
+static int
+op_buffer(GEOSContextHandle_t ctx, const GEOSGeometry* g, double arg)
+{
+    GEOSGeometry* result = GEOSBuffer_r(ctx, g, arg, 8);
+    GEOSGeom_destroy_r(ctx, result);
+    return result != NULL;
+}
+
+static int
+op_simplify(GEOSContextHandle_t ctx, const GEOSGeometry* g, double arg)
+{
+    GEOSGeometry* result = GEOSTopologyPreserveSimplify_r(ctx, g, arg);
+    GEOSGeom_destroy_r(ctx, result);
+    return result != NULL;
+}
+
+static int
+op_convexhull(GEOSContextHandle_t ctx, const GEOSGeometry* g, double arg)
+{
+    GEOSGeometry* result = GEOSConvexHull_r(ctx, g);
+    GEOSGeom_destroy_r(ctx, result);
+    return result != NULL;
+}
+
+static const gp_pipeline_op pipeline_ops[] = {
+    {"parse", op_parse, 0.0},
+    {"isvalid", op_isvalid, 0.0},
+    {"buffer", op_buffer, 10.0},
+    {"simplify", op_simplify, 10.0},
+    {"convexhull", op_convexhull, 0.0},
+    {NULL, NULL, 0.0}
+};
+
+
+/************************************************************************
+* Reader and worker threads
+*/
+
+static int
+reader_line(const char* line, size_t len, void* data)
+{
+    gp_queue* q = (gp_queue*)data;
+    char* copy;
+    if (len == 0)
+        return 0;
+    copy = malloc(len + 1);
+    memcpy(copy, line, len + 1);
+    queue_push(q, copy, len);
+    return 0;
+}
+
+typedef struct {
+    gp_queue* queue;
+    const char* file_name;
+    int status;
+} gp_pipeline_reader;
+
+static void*
+reader_main(void* arg)
+{
+    gp_pipeline_reader* r = (gp_pipeline_reader*)arg;
+    r->status = read_data_lines(r->file_name, reader_line, r->queue);
+    queue_close(r->queue);
+    return NULL;
+}
+
+static void
+pipeline_log_stderr(const char* message, void* userdata)
+{
+    debug_stderr(1, "%s\n", message);
+}
+
+static void*
+worker_main(void* arg)
+{
+    gp_pipeline_worker* w = (gp_pipeline_worker*)arg;
+    GEOSContextHandle_t ctx = GEOS_init_r();
+    GEOSWKTReader* reader;
+    char* line;
+
+    GEOSContext_setNoticeMessageHandler_r(ctx, pipeline_log_stderr, NULL);
+    GEOSContext_setErrorMessageHandler_r(ctx, pipeline_log_stderr, NULL);
+    reader = GEOSWKTReader_create_r(ctx);
+
+    while ((line = queue_pop(w->queue)) != NULL)
+    {
+        GEOSGeometry* g = GEOSWKTReader_read_r(ctx, reader, line);
+        free(line);
+        if (!g || !w->op->func(ctx, g, w->arg))
+            w->errors++;
+        if (g)
+            GEOSGeom_destroy_r(ctx, g);
+        w->features++;
+    }
+
+    GEOSWKTReader_destroy_r(ctx, reader);
+    GEOS_finish_r(ctx);
+    return NULL;
+}
+
+static const gp_pipeline_op*
+pipeline_op_find(const char* spec, double* arg)
+{
+    const gp_pipeline_op* op;
+    const char* colon = strchr(spec, ':');
+    size_t len = colon ? (size_t)(colon - spec) : strlen(spec);
+    for (op = pipeline_ops; op->name; op++)
+    {
+        if (strlen(op->name) == len && strncmp(op->name, spec, len) == 0)
+        {
+            *arg = colon ? strtod(colon + 1, NULL) : op->default_arg;
+            return op;
+        }
+    }
+    return NULL;
+}
+
+int
+run_pipeline(const char* op_spec, const char* file_name, uint32_t nworkers,
+             size_t queue_size, gp_pipeline_result* result)
+{
+    uint32_t i;
+    double arg, start, end;
+    long rss_start;
+    gp_queue queue;
+    gp_pipeline_reader reader;
+    pthread_t reader_thread;
+    pthread_t* threads;
+    gp_pipeline_worker* workers;
+    const gp_pipeline_op* op = pipeline_op_find(op_spec, &arg);
+
+    if (!op)
+    {
+        fprintf(stderr, "unknown pipeline operation '%s', use one of", op_spec);
+        for (op = pipeline_ops; op->name; op++)
+            fprintf(stderr, " %s", op->name);
+        fprintf(stderr, "\n");
+        return 0;
+    }
+    if (nworkers < 1)
+        nworkers = 1;
+    if (queue_size < 1)
+        queue_size = PIPELINE_DEFAULT_QUEUE;
+
+    queue_init(&queue, queue_size);
+    threads = calloc(nworkers, sizeof(pthread_t));
+    workers = calloc(nworkers, sizeof(gp_pipeline_worker));
+    reader.queue = &queue;
+    reader.file_name = file_name;
+    reader.status = 0;
+
+    rss_start = peak_rss();
+    start = seconds_now();
+
+    /*
+    * Workers start first, so if the reader thread can't be
+    * started the reader runs here with the workers draining
+    * the queue. Go on with fewer workers if some can't start.
+    */
+    for (i = 0; i < nworkers; i++)
+    {
+        workers[i].queue = &queue;
+        workers[i].op = op;
+        workers[i].arg = arg;
+        if (pthread_create(threads + i, NULL, worker_main, workers + i) != 0)
+            break;
+    }
+    if (i < nworkers)
+    {
+        fprintf(stderr, "could only start %u of %u pipeline workers\n", i, nworkers);
+        nworkers = i;
+    }
+    if (nworkers == 0)
+    {
+        queue_free(&queue);
+        free(workers);
+        free(threads);
+        return 0;
+    }
+    if (pthread_create(&reader_thread, NULL, reader_main, &reader) == 0)
+        pthread_join(reader_thread, NULL);
+    else
+        reader_main(&reader);
+    for (i = 0; i < nworkers; i++)
+        pthread_join(threads[i], NULL);
+    end = seconds_now();
+
+    memset(result, 0, sizeof(gp_pipeline_result));
+    result->version = GEOSversion();
+    result->op = op->name;
+    result->arg = arg;
+    result->file_name = file_name;
+    result->workers = nworkers;
+    result->queue_size = queue_size;
+    for (i = 0; i < nworkers; i++)
+    {
+        result->features += workers[i].features;
+        result->errors += workers[i].errors;
+    }
+    result->wall_time = end - start;
+    result->bytes = queue.total_bytes;
+    result->features_per_sec = result->wall_time > 0.0 ? result->features / result->wall_time : 0.0;
+    result->mb_per_sec = result->wall_time > 0.0 ? result->bytes / result->wall_time / 1e6 : 0.0;
+    result->peak_queue = queue.peak_count;
+    result->peak_queue_bytes = queue.peak_bytes;
+    result->reader_waits = queue.reader_waits;
+    result->peak_rss = peak_rss();
+    result->rss_delta = result->peak_rss - rss_start;
+
+    queue_free(&queue);
+    free(workers);
+    free(threads);
+    return reader.status == 0;
+}
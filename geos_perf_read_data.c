@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <pthread.h>
 #include <zlib.h>
 
 #include "geos_perf.h"
@@ -11,8 +12,8 @@
 
 /* The following macro calls a zlib routine and checks the return
    value. If the return value ("status") is not OK, it prints an error
-   message and exits the program. Zlib's error statuses are all less
-   than zero. */
+   message and returns -1 from the calling function. Zlib's error
+   statuses are all less than zero. */
 
 #define CALL_ZLIB(x) {                                                  \
         int status;                                                     \
@@ -21,49 +22,52 @@
             fprintf (stderr,                                            \
                      "%s:%d: %s returned a bad status of %d.\n",        \
                      __FILE__, __LINE__, #x, status);                   \
-            exit (EXIT_FAILURE);                                        \
+            return -1;                                                  \
         }                                                               \
     }
 
-/* if "test" is true, print an error message and halt execution. */
+/* if "test" is true, print an error message, clean up and return -1,
+   so a missing or unreadable file fails the load, not the run. */
 
 #define FAIL(test,file_name,message) {                   \
         if (test) {                                      \
             inflateEnd (& strm);                         \
+            if (file)                                    \
+                fclose (file);                           \
+            free (line);                                 \
             fprintf (stderr, "%s:%d: " message           \
                      " file '%s' failed: %s\n",          \
                      __FILE__, __LINE__, file_name,      \
                      strerror (errno));                  \
-            exit (EXIT_FAILURE);                         \
+            return -1;                                   \
         }                                                \
     }
 
-#define TFAIL(test,message) {                            \
-        if (test) {                                      \
-            fprintf (stderr, "%s:%d: " message           \
-                     " file '%s' failed: %s\n",          \
-                     __FILE__, __LINE__, file_name,      \
-                     strerror (errno));                  \
-            exit (EXIT_FAILURE);                         \
-        }                                                \
-    }
-
-
 /* These are parameters to inflateInit2. See
    http://zlib.net/manual.html for the exact meanings. */
 #define INFLATE_WINDOW_BITS 15
 #define ENABLE_ZLIB_GZIP 32
 
-#define TMPFILE "/tmp/geos_perf_tmp"
-
+/*
+* Inflate a gzipped file a chunk at a time and hand each line
+* to func as soon as it is complete, without the line ending.
+* Lines are gathered in one buffer that grows to the longest
+* line and is reused for every line, so nothing is written to
+* disk and memory use does not depend on the file size.
+*/
 static int
-decompress_data_file(const char* file_name, const char* out_file_name)
+inflate_lines(const char* file_name, gp_line_func func, void* data)
 {
-    FILE * file;
-    FILE * outfile;
+    FILE * file = NULL;
     z_stream strm = {0};
     unsigned char in[CHUNK_SIZE];
     unsigned char out[CHUNK_SIZE];
+    char* line = NULL;
+    size_t linelen = 0;
+    size_t linecap = 0;
+    int stopped = 0;
+    int zlib_status = Z_OK;
+    int closed;
 
     strm.zalloc = Z_NULL;
     strm.zfree = Z_NULL;
@@ -75,102 +79,407 @@ decompress_data_file(const char* file_name, const char* out_file_name)
     /* Open the file. */
     file = fopen(file_name, "rb");
     FAIL (!file, file_name, "open input");
-    outfile = fopen(out_file_name, "w");
-    FAIL (!outfile, out_file_name, "open output");
-    while (1)
-    {
-        int bytes_read;
-        int zlib_status;
 
-        bytes_read = fread (in, sizeof (char), sizeof (in), file);
+    while (!stopped)
+    {
+        size_t bytes_read = fread (in, sizeof (char), sizeof (in), file);
         FAIL (ferror (file), file_name, "read");
-        strm.avail_in = bytes_read;
+        if (bytes_read == 0)
+            break;
+        strm.avail_in = (uInt)bytes_read;
         strm.next_in = in;
 
-        do {
-            unsigned have;
+        /* Inflate until the input is used up and zlib has no more output */
+        do
+        {
+            unsigned char* start;
+            unsigned char* end;
             strm.avail_out = CHUNK_SIZE;
             strm.next_out = out;
             zlib_status = inflate (& strm, Z_NO_FLUSH);
             switch (zlib_status)
             {
                 case Z_OK:
-                case Z_STREAM_END:
                 case Z_BUF_ERROR:
                     break;
 
+                /* Concatenated gzip members carry on with the next one */
+                case Z_STREAM_END:
+                    inflateReset(&strm);
+                    break;
+
                 default:
                     inflateEnd (& strm);
+                    fclose (file);
+                    free (line);
                     fprintf (stderr, "Gzip error %d in '%s'.\n", zlib_status, file_name);
                     return -1;
             }
-            have = CHUNK_SIZE - strm.avail_out;
-            /* Copy the decompressed output to the landing location */
-            fwrite (out, sizeof(unsigned char), have, outfile);
-        } while (strm.avail_out == 0);
 
-        if (feof(file)) {
-            inflateEnd(&strm);
-            break;
-        }
+            /* Split the inflated chunk on newlines */
+            start = out;
+            end = strm.next_out;
+            while (start < end && !stopped)
+            {
+                unsigned char* newline = memchr(start, '\n', end - start);
+                size_t n = (newline ? newline : end) - start;
+                if (linelen + n + 1 > linecap)
+                {
+                    linecap = linecap ? 2 * linecap : CHUNK_SIZE;
+                    while (linelen + n + 1 > linecap)
+                        linecap *= 2;
+                    line = realloc(line, linecap);
+                }
+                memcpy(line + linelen, start, n);
+                linelen += n;
+                if (!newline)
+                    break;
+                if (linelen > 0 && line[linelen - 1] == '\r')
+                    linelen--;
+                line[linelen] = '\0';
+                stopped = func(line, linelen, data);
+                linelen = 0;
+                start = newline + 1;
+            }
+        } while ((strm.avail_in > 0 || strm.avail_out == 0) && !stopped);
     }
-    FAIL (fclose (file), file_name, "close input");
-    FAIL (fclose (outfile), out_file_name, "close output");
+
+    /* A last line without a newline */
+    if (!stopped && linelen > 0)
+    {
+        line[linelen] = '\0';
+        func(line, linelen, data);
+    }
+
+    inflateEnd(&strm);
+    free(line);
+    line = NULL;
+    closed = fclose(file);
+    file = NULL;
+    FAIL (closed != 0, file_name, "close input");
     return 0;
 }
 
 int
-read_data_file(const char* file_name, GEOSGeometryList* geoms)
+read_data_lines(const char* file_name, gp_line_func func, void* data)
 {
     char full_file_name[MAXSTRLEN];
-    snprintf(full_file_name, MAXSTRLEN, "%s/%s", DATA_DIR, file_name);
-    int read_rv = decompress_data_file(full_file_name, TMPFILE);
+    data_path(file_name, full_file_name, MAXSTRLEN);
+    return inflate_lines(full_file_name, func, data);
+}
 
-    char *line = NULL;
-    size_t linecap = 0;
-    ssize_t linelen;
-    FILE * file = fopen(TMPFILE, "r");
-    TFAIL (!file, "open tmp input");
+typedef struct {
+    GEOSContextHandle_t ctx;
+    GEOSWKTReader* reader;
+    GEOSGeometryList* geoms;
+} gp_wkt_lines;
+
+/* Parse one line, using the context-free API when ctx is NULL */
+static int
+read_wkt_line(const char* line, size_t len, void* data)
+{
+    gp_wkt_lines* wkt = (gp_wkt_lines*)data;
+    GEOSGeometry* g;
+    if (len == 0)
+        return 0;
+    g = wkt->ctx ?
+        GEOSWKTReader_read_r(wkt->ctx, wkt->reader, line) :
+        GEOSWKTReader_read(wkt->reader, line);
+    if (g)
+        geomlist_push(wkt->geoms, g);
+    return 0;
+}
+
+/* Read one geometry and stop */
+static int
+read_wkt_first_line(const char* line, size_t len, void* data)
+{
+    read_wkt_line(line, len, data);
+    return geomlist_size(((gp_wkt_lines*)data)->geoms) > 0;
+}
+
+static int
+read_wkt_lines(GEOSContextHandle_t ctx, const char* file_name, GEOSGeometryList* geoms, gp_line_func func)
+{
+    int rv;
+    gp_wkt_lines wkt;
+    wkt.ctx = ctx;
+    wkt.reader = ctx ? GEOSWKTReader_create_r(ctx) : GEOSWKTReader_create();
+    wkt.geoms = geoms;
+    rv = read_data_lines(file_name, func, &wkt);
+    if (ctx)
+        GEOSWKTReader_destroy_r(ctx, wkt.reader);
+    else
+        GEOSWKTReader_destroy(wkt.reader);
+    return rv;
+}
+
+/*
+* Parallel parsing. The input is already in memory as a
+* buffer of items with an offset index, which is cut into one
+* line-aligned run of items per thread, balanced by bytes
+* rather than item count since feature sizes vary a lot. Each
+* worker parses with its own context and reader into its own
+* list, and the lists are appended in chunk order afterwards,
+* so the result is in file order no matter which thread
+* finishes first. Geometries are not tied to the context that
+* read them, so the worker contexts are finished straight away.
+*/
+static uint32_t load_threads = 1;
+
+void
+load_threads_set(uint32_t nthreads)
+{
+    load_threads = nthreads > 0 ? nthreads : 1;
+}
+
+uint32_t
+load_threads_get(void)
+{
+    return load_threads;
+}
+
+typedef struct {
+    gp_parse_range_func func;
+    const unsigned char* data;
+    const uint64_t* offsets;
+    size_t begin;
+    size_t end;
+    GEOSGeometryList geoms;
+} gp_parse_chunk;
+
+static void
+parse_log_stderr(const char* message, void* userdata)
+{
+    fprintf(stderr, "%s\n", message);
+}
+
+static void*
+parse_chunk_main(void* arg)
+{
+    gp_parse_chunk* chunk = (gp_parse_chunk*)arg;
+    GEOSContextHandle_t ctx = GEOS_init_r();
+    GEOSContext_setNoticeMessageHandler_r(ctx, parse_log_stderr, NULL);
+    GEOSContext_setErrorMessageHandler_r(ctx, parse_log_stderr, NULL);
+    chunk->func(ctx, chunk->data, chunk->offsets, chunk->begin, chunk->end, &chunk->geoms);
+    GEOS_finish_r(ctx);
+    return NULL;
+}
 
-    GEOSWKTReader* reader = GEOSWKTReader_create();
-    while ((linelen = getline(&line, &linecap, file)) > 0)
+int
+parse_parallel(const unsigned char* data, const uint64_t* offsets, size_t nitems,
+               gp_parse_range_func func, GEOSGeometryList* geoms)
+{
+    size_t i, j, begin = 0;
+    size_t nthreads = load_threads < nitems ? load_threads : nitems;
+    uint64_t total;
+    gp_parse_chunk* chunks;
+    pthread_t* threads;
+
+    if (nthreads < 1)
+        return 0;
+
+    chunks = calloc(nthreads, sizeof(gp_parse_chunk));
+    threads = calloc(nthreads, sizeof(pthread_t));
+    total = offsets[nitems] - offsets[0];
+
+    for (i = 0; i < nthreads; i++)
     {
-        GEOSGeometry* g = GEOSWKTReader_read(reader, line);
-        if (g)
-        {
-            size_t glsz = geomlist_push(geoms, g);
-        }
+        gp_parse_chunk* chunk = chunks + i;
+        uint64_t target = offsets[0] + total * (i + 1) / nthreads;
+        size_t end = begin;
+        while (end < nitems && offsets[end] < target)
+            end++;
+        if (i == nthreads - 1)
+            end = nitems;
+        chunk->func = func;
+        chunk->data = data;
+        chunk->offsets = offsets;
+        chunk->begin = begin;
+        chunk->end = end;
+        geomlist_init(&chunk->geoms);
+        pthread_create(threads + i, NULL, parse_chunk_main, chunk);
+        begin = end;
     }
-    GEOSWKTReader_destroy(reader);
 
-    TFAIL (fclose (file), "close input");
+    for (i = 0; i < nthreads; i++)
+    {
+        pthread_join(threads[i], NULL);
+        for (j = 0; j < geomlist_size(&chunks[i].geoms); j++)
+            geomlist_push(geoms, chunks[i].geoms.geoms[j]);
+        geomlist_release(&chunks[i].geoms);
+    }
 
+    free(threads);
+    free(chunks);
     return 0;
 }
 
-GEOSGeometry *
-read_geometry_file(const char* file_name)
+/* Whole decompressed file, with every line NUL terminated */
+typedef struct {
+    unsigned char* text;
+    size_t size;
+    size_t capacity;
+    uint64_t* offsets;
+    size_t nlines;
+    size_t offsets_capacity;
+} gp_text_lines;
+
+static int
+gather_line(const char* line, size_t len, void* data)
 {
-    char full_file_name[MAXSTRLEN];
-    snprintf(full_file_name, MAXSTRLEN, "%s/%s", DATA_DIR, file_name);
-    int read_rv = decompress_data_file(full_file_name, TMPFILE);
+    gp_text_lines* lines = (gp_text_lines*)data;
+    if (len == 0)
+        return 0;
+    if (lines->size + len + 1 > lines->capacity)
+    {
+        lines->capacity = lines->capacity ? 2 * lines->capacity : CHUNK_SIZE;
+        while (lines->size + len + 1 > lines->capacity)
+            lines->capacity *= 2;
+        lines->text = realloc(lines->text, lines->capacity);
+    }
+    /* Room for this line's offset and the end offset */
+    if (lines->nlines + 2 > lines->offsets_capacity)
+    {
+        lines->offsets_capacity = lines->offsets_capacity ? 2 * lines->offsets_capacity : 1024;
+        lines->offsets = realloc(lines->offsets, sizeof(uint64_t) * lines->offsets_capacity);
+    }
+    lines->offsets[lines->nlines++] = lines->size;
+    memcpy(lines->text + lines->size, line, len + 1);
+    lines->size += len + 1;
+    lines->offsets[lines->nlines] = lines->size;
+    return 0;
+}
 
-    char *line = NULL;
-    size_t linecap = 0;
-    ssize_t linelen;
-    FILE * file = fopen(TMPFILE, "r");
-    TFAIL (!file, "open tmp input");
+static void
+parse_wkt_range(GEOSContextHandle_t ctx, const unsigned char* data,
+                const uint64_t* offsets, size_t begin, size_t end,
+                GEOSGeometryList* geoms)
+{
+    size_t i;
+    GEOSWKTReader* reader = GEOSWKTReader_create_r(ctx);
+    for (i = begin; i < end; i++)
+    {
+        GEOSGeometry* g = GEOSWKTReader_read_r(ctx, reader, (const char*)data + offsets[i]);
+        if (g)
+            geomlist_push(geoms, g);
+    }
+    GEOSWKTReader_destroy_r(ctx, reader);
+}
+
+/*
+* Inflating is serial, so the whole file is inflated into memory
+* first and then parsed in parallel.
+*/
+static int
+read_wkt_parallel(const char* file_name, GEOSGeometryList* geoms)
+{
+    int rv;
+    gp_text_lines lines;
+    memset(&lines, 0, sizeof(lines));
+    rv = read_data_lines(file_name, gather_line, &lines);
+    if (rv == 0 && lines.nlines > 0)
+        rv = parse_parallel(lines.text, lines.offsets, lines.nlines, parse_wkt_range, geoms);
+    free(lines.text);
+    free(lines.offsets);
+    return rv;
+}
+
+/*
+* Loads through read_data_file() go through the WKB cache, and
+* both the WKT parse and the cached load are timed, so setup
+* output can show what the cache saves.
+*/
+static gp_load_stats load_stats;
+
+void
+load_stats_reset(void)
+{
+    memset(&load_stats, 0, sizeof(load_stats));
+}
 
-    GEOSGeometry *g;
+void
+load_stats_read(gp_load_stats* stats)
+{
+    *stats = load_stats;
+}
 
-    GEOSWKTReader* reader = GEOSWKTReader_create();
-    if ((linelen = getline(&line, &linecap, file)) > 0)
+static int
+read_data_cached(GEOSContextHandle_t ctx, const char* file_name, GEOSGeometryList* geoms)
+{
+    int rv = 0;
+    double wkt_time;
+    size_t ngeoms = geomlist_size(geoms);
+    double start = seconds_now();
+
+    if (cache_load(ctx, file_name, geoms, &wkt_time))
     {
-        g = GEOSWKTReader_read(reader, line);
+        load_stats.cache_time += seconds_now() - start;
+        load_stats.cache_hits++;
     }
-    GEOSWKTReader_destroy(reader);
+    else
+    {
+        GEOSGeometryList loaded;
+        size_t i;
+        /* Cache only this file's geometries, the list may already hold others */
+        geomlist_init(&loaded);
+        if (load_threads > 1)
+            rv = read_wkt_parallel(file_name, &loaded);
+        else
+            rv = read_wkt_lines(ctx, file_name, &loaded, read_wkt_line);
+        wkt_time = seconds_now() - start;
+        if (rv == 0)
+            cache_store(ctx, file_name, &loaded, wkt_time);
+        for (i = 0; i < geomlist_size(&loaded); i++)
+            geomlist_push(geoms, loaded.geoms[i]);
+        geomlist_release(&loaded);
+    }
+    load_stats.wkt_time += wkt_time;
+    load_stats.files++;
+    load_stats.threads = load_threads;
+    load_stats.geoms += geomlist_size(geoms) - ngeoms;
+    return rv;
+}
 
-    TFAIL (fclose (file), "close input");
+int
+read_data_file(const char* file_name, GEOSGeometryList* geoms)
+{
+    return read_data_file_r(NULL, file_name, geoms);
+}
+
+int
+read_data_file_r(GEOSContextHandle_t ctx, const char* file_name, GEOSGeometryList* geoms)
+{
+    int rv;
+    size_t begin = geomlist_size(geoms);
+    if (synthetic_is_name(file_name))
+        rv = synthetic_generate(ctx, file_name, geoms);
+    else
+        rv = read_data_cached(ctx, file_name, geoms);
+    if (rv == 0 && !data_counts_known(file_name))
+    {
+        size_t i;
+        uint64_t vertices = 0;
+        for (i = begin; i < geomlist_size(geoms); i++)
+        {
+            const GEOSGeometry* g = geomlist_get(geoms, i);
+            vertices += ctx ? GEOSGetNumCoordinates_r(ctx, g) : GEOSGetNumCoordinates(g);
+        }
+        data_counts_note(file_name, geomlist_size(geoms) - begin, vertices);
+    }
+    order_apply(ctx, geoms, begin);
+    return rv;
+}
 
+GEOSGeometry *
+read_geometry_file(const char* file_name)
+{
+    GEOSGeometryList geoms;
+    GEOSGeometry* g = NULL;
+    geomlist_init(&geoms);
+    read_wkt_lines(NULL, file_name, &geoms, read_wkt_first_line);
+    if (geomlist_size(&geoms) > 0)
+        g = geomlist_pop(&geoms);
+    geomlist_release(&geoms);
     return g;
 }
@@ -0,0 +1,279 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "geos_perf.h"
+
+/************************************************************************
+* Deterministic pseudo-random numbers (splitmix64), so that
+* resampling and generated data are the same on every run.
+*/
+
+uint64_t
+random_next(uint64_t* state)
+{
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+double
+random_double(uint64_t* state)
+{
+    /* 53 random bits into [0, 1) */
+    return (double)(random_next(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/************************************************************************
+* Summary statistics over a set of per-iteration samples.
+*/
+
+static int
+cmp_double(const void* a, const void* b)
+{
+    double da = *(const double*)a;
+    double db = *(const double*)b;
+    return (da > db) - (da < db);
+}
+
+void
+stats_sort(double* samples, size_t nsamples)
+{
+    qsort(samples, nsamples, sizeof(double), cmp_double);
+}
+
+/*
+* Percentile of an already sorted array, linearly interpolating
+* between the two closest ranks.
+*/
+double
+stats_percentile(const double* sorted, size_t nsamples, double pct)
+{
+    double rank, frac;
+    size_t lo;
+    if (nsamples == 0)
+        return 0.0;
+    if (nsamples == 1)
+        return sorted[0];
+    rank = (pct / 100.0) * (double)(nsamples - 1);
+    lo = (size_t)rank;
+    if (lo >= nsamples - 1)
+        return sorted[nsamples - 1];
+    frac = rank - (double)lo;
+    return sorted[lo] + frac * (sorted[lo + 1] - sorted[lo]);
+}
+
+/*
+* The ranks bracketing the median come from the binomial
+* distribution of the number of samples below it, using the
+* normal approximation with z = 1.96.
+*/
+int
+stats_median_ci(const double* sorted, size_t nsamples, double* lo, double* hi)
+{
+    double half = 1.96 * sqrt((double)nsamples) / 2.0;
+    double rlo = floor((double)nsamples / 2.0 - half);
+    double rhi = ceil(1.0 + (double)nsamples / 2.0 + half);
+    if (rlo < 1.0 || rhi > (double)nsamples)
+        return 0;
+    *lo = sorted[(size_t)rlo - 1];
+    *hi = sorted[(size_t)rhi - 1];
+    return 1;
+}
+
+void
+stats_compute(const double* samples, size_t nsamples, gp_stats* stats)
+{
+    size_t i;
+    double sum = 0.0, sumsq = 0.0;
+    double* sorted;
+
+    memset(stats, 0, sizeof(gp_stats));
+    if (nsamples == 0)
+        return;
+
+    sorted = malloc(sizeof(double) * nsamples);
+    memcpy(sorted, samples, sizeof(double) * nsamples);
+    stats_sort(sorted, nsamples);
+
+    for (i = 0; i < nsamples; i++)
+        sum += sorted[i];
+    stats->mean = sum / (double)nsamples;
+
+    for (i = 0; i < nsamples; i++)
+    {
+        double d = sorted[i] - stats->mean;
+        sumsq += d * d;
+    }
+    stats->stddev = nsamples > 1 ? sqrt(sumsq / (double)(nsamples - 1)) : 0.0;
+
+    stats->min = sorted[0];
+    stats->max = sorted[nsamples - 1];
+    stats->p50 = stats_percentile(sorted, nsamples, 50.0);
+    stats->p90 = stats_percentile(sorted, nsamples, 90.0);
+    stats->p99 = stats_percentile(sorted, nsamples, 99.0);
+    if (!stats_median_ci(sorted, nsamples, &stats->p50_ci_lo, &stats->p50_ci_hi))
+    {
+        stats->p50_ci_lo = stats->min;
+        stats->p50_ci_hi = stats->max;
+    }
+
+    free(sorted);
+}
+
+/*
+* Percentile bootstrap of the median: resample with
+* replacement, take the median of each resample, and
+* use the 2.5 and 97.5 percentiles of those medians.
+*/
+#define BOOTSTRAP_SEED 0x67656f73ULL
+
+void
+stats_bootstrap_median_ci(const double* samples, size_t nsamples,
+                          uint32_t resamples, double* lo, double* hi)
+{
+    uint32_t r;
+    size_t i;
+    uint64_t rng = BOOTSTRAP_SEED;
+    double* resample;
+    double* medians;
+
+    if (nsamples == 0 || resamples == 0)
+    {
+        *lo = *hi = 0.0;
+        return;
+    }
+
+    resample = malloc(sizeof(double) * nsamples);
+    medians = malloc(sizeof(double) * resamples);
+    for (r = 0; r < resamples; r++)
+    {
+        for (i = 0; i < nsamples; i++)
+            resample[i] = samples[random_next(&rng) % nsamples];
+        stats_sort(resample, nsamples);
+        medians[r] = stats_percentile(resample, nsamples, 50.0);
+    }
+    stats_sort(medians, resamples);
+    *lo = stats_percentile(medians, resamples, 2.5);
+    *hi = stats_percentile(medians, resamples, 97.5);
+    free(medians);
+    free(resample);
+}
+
+/*
+* Bootstrap of the ratio of medians of two independent sets
+* of samples, median(b) / median(a), resampling each set
+* separately.
+*/
+void
+stats_bootstrap_ratio_ci(const double* a, size_t na,
+                         const double* b, size_t nb,
+                         uint32_t resamples, double* lo, double* hi)
+{
+    uint32_t r;
+    size_t i;
+    uint64_t rng = BOOTSTRAP_SEED;
+    double* resample_a;
+    double* resample_b;
+    double* ratios;
+
+    if (na == 0 || nb == 0 || resamples == 0)
+    {
+        *lo = *hi = 0.0;
+        return;
+    }
+
+    resample_a = malloc(sizeof(double) * na);
+    resample_b = malloc(sizeof(double) * nb);
+    ratios = malloc(sizeof(double) * resamples);
+    for (r = 0; r < resamples; r++)
+    {
+        double median_a, median_b;
+        for (i = 0; i < na; i++)
+            resample_a[i] = a[random_next(&rng) % na];
+        for (i = 0; i < nb; i++)
+            resample_b[i] = b[random_next(&rng) % nb];
+        stats_sort(resample_a, na);
+        stats_sort(resample_b, nb);
+        median_a = stats_percentile(resample_a, na, 50.0);
+        median_b = stats_percentile(resample_b, nb, 50.0);
+        ratios[r] = median_a > 0.0 ? median_b / median_a : 1.0;
+    }
+    stats_sort(ratios, resamples);
+    *lo = stats_percentile(ratios, resamples, 2.5);
+    *hi = stats_percentile(ratios, resamples, 97.5);
+    free(ratios);
+    free(resample_b);
+    free(resample_a);
+}
+
+typedef struct {
+    double value;
+    int group;
+} gp_ranked;
+
+static int
+cmp_ranked(const void* a, const void* b)
+{
+    double da = ((const gp_ranked*)a)->value;
+    double db = ((const gp_ranked*)b)->value;
+    return (da > db) - (da < db);
+}
+
+/*
+* Two-sided Mann-Whitney U test, using the normal
+* approximation with tie and continuity corrections.
+*/
+double
+stats_mann_whitney(const double* a, size_t na, const double* b, size_t nb)
+{
+    size_t i, j, n = na + nb;
+    double rank_sum_a = 0.0, tie_sum = 0.0;
+    double u, mu, sigma, z;
+    gp_ranked* ranked;
+
+    if (na == 0 || nb == 0)
+        return 1.0;
+
+    ranked = malloc(sizeof(gp_ranked) * n);
+    for (i = 0; i < na; i++)
+    {
+        ranked[i].value = a[i];
+        ranked[i].group = 0;
+    }
+    for (i = 0; i < nb; i++)
+    {
+        ranked[na + i].value = b[i];
+        ranked[na + i].group = 1;
+    }
+    qsort(ranked, n, sizeof(gp_ranked), cmp_ranked);
+
+    /* Tied values all get the average of their ranks */
+    for (i = 0; i < n; i = j)
+    {
+        double t, rank;
+        for (j = i + 1; j < n && ranked[j].value == ranked[i].value; j++)
+            ;
+        t = (double)(j - i);
+        rank = (double)(i + 1 + j) / 2.0;
+        for (size_t k = i; k < j; k++)
+        {
+            if (ranked[k].group == 0)
+                rank_sum_a += rank;
+        }
+        tie_sum += t * t * t - t;
+    }
+    free(ranked);
+
+    u = rank_sum_a - (double)na * (double)(na + 1) / 2.0;
+    mu = (double)na * (double)nb / 2.0;
+    sigma = sqrt((double)na * (double)nb / 12.0 *
+                 ((double)(n + 1) - tie_sum / ((double)n * (double)(n - 1))));
+    if (sigma <= 0.0)
+        return 1.0;
+    z = (fabs(u - mu) - 0.5) / sigma;
+    if (z < 0.0)
+        z = 0.0;
+    return erfc(z / sqrt(2.0));
+}
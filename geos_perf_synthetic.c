@@ -0,0 +1,304 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "geos_perf.h"
+
+/************************************************************************
+* Synthetic datasets.
+*
+* Generated in place of a data file when a test asks for a name
+*
+*   synthetic:KIND:COUNT[:VERTICES[:SEED]]
+*
+* so tests can pick their input by size, up to millions of
+* features, without shipping the files. The same name always
+* gives the same geometries, as everything is drawn from one
+* seeded generator in a fixed order. Features are spread over a
+* square whose area grows with the count, so the density, and
+* the number of neighbours of each feature, stays about the same
+* at every size.
+*
+* Kinds are:
+*
+*   uniform       points, uniformly distributed
+*   clustered     points, in normally distributed clusters of
+*                 about 1000 points each
+*   grid          points, on a regular square grid
+*   walk          linestrings of VERTICES vertices, random walks
+*                 that drift in one direction
+*   polygon       star-shaped polygons with VERTICES shell vertices
+*   holes         star-shaped polygons with one hole of half as
+*                 many vertices
+*   selftouch     star-shaped polygons whose shell also runs out
+*                 to a spike that touches the shell at one vertex,
+*                 an inverted hole that OGC validity rejects
+*/
+
+#define SYNTHETIC_PREFIX "synthetic:"
+#define SYNTHETIC_DEFAULT_VERTICES 32
+#define SYNTHETIC_DEFAULT_SEED 1
+#define SYNTHETIC_CLUSTER_SIZE 1000
+
+/* Side of the square that holds one feature on average */
+#define SYNTHETIC_CELL 100.0
+
+static const char* const synthetic_kinds[] = {
+    "uniform", "clustered", "grid", "walk",
+    "polygon", "holes", "selftouch", NULL
+};
+
+typedef struct {
+    GEOSContextHandle_t ctx;
+    uint64_t rng;
+    double extent;
+    uint32_t vertices;
+    double* xy;
+} gp_synthetic;
+
+int
+synthetic_is_name(const char* name)
+{
+    return strncmp(name, SYNTHETIC_PREFIX, strlen(SYNTHETIC_PREFIX)) == 0;
+}
+
+int
+synthetic_kind_known(const char* kind)
+{
+    size_t i;
+    for (i = 0; synthetic_kinds[i]; i++)
+    {
+        if (strcmp(kind, synthetic_kinds[i]) == 0)
+            return 1;
+    }
+    return 0;
+}
+
+/* Standard normal variate, Box-Muller */
+static double
+random_normal(uint64_t* rng)
+{
+    double u = random_double(rng);
+    double v = random_double(rng);
+    if (u < 1e-300)
+        u = 1e-300;
+    return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+}
+
+static GEOSCoordSequence*
+synthetic_coords(gp_synthetic* s, unsigned int n)
+{
+#if GEOS_VERSION_CMP >= 310
+    return GEOSCoordSeq_copyFromBuffer_r(s->ctx, s->xy, n, 0, 0);
+#else
+    unsigned int i;
+    GEOSCoordSequence* seq = GEOSCoordSeq_create_r(s->ctx, n, 2);
+    for (i = 0; i < n; i++)
+    {
+        GEOSCoordSeq_setX_r(s->ctx, seq, i, s->xy[2 * i]);
+        GEOSCoordSeq_setY_r(s->ctx, seq, i, s->xy[2 * i + 1]);
+    }
+    return seq;
+#endif
+}
+
+static GEOSGeometry*
+synthetic_point(gp_synthetic* s, double x, double y)
+{
+    s->xy[0] = x;
+    s->xy[1] = y;
+    return GEOSGeom_createPoint_r(s->ctx, synthetic_coords(s, 1));
+}
+
+/*
+* Fill xy from offset with a closed star-shaped ring around
+* (cx, cy), with the radius of each vertex drawn from
+* [rmin, rmax] times r, counter-clockwise unless reversed.
+* Returns the number of coordinates written.
+*/
+static unsigned int
+synthetic_star(gp_synthetic* s, double* xy, unsigned int nvertices,
+               double cx, double cy, double r, double rmin, double rmax, int reversed)
+{
+    unsigned int i;
+    double start = 2.0 * M_PI * random_double(&s->rng);
+    for (i = 0; i < nvertices; i++)
+    {
+        double a = start + (reversed ? -1.0 : 1.0) * 2.0 * M_PI * i / nvertices;
+        double radius = r * (rmin + (rmax - rmin) * random_double(&s->rng));
+        xy[2 * i] = cx + radius * cos(a);
+        xy[2 * i + 1] = cy + radius * sin(a);
+    }
+    xy[2 * nvertices] = xy[0];
+    xy[2 * nvertices + 1] = xy[1];
+    return nvertices + 1;
+}
+
+static GEOSGeometry*
+synthetic_polygon(gp_synthetic* s, int holes, int selftouch)
+{
+    unsigned int n;
+    double cx = s->extent * random_double(&s->rng);
+    double cy = s->extent * random_double(&s->rng);
+    double r = 0.5 * SYNTHETIC_CELL;
+    GEOSGeometry* shell;
+    GEOSGeometry* hole = NULL;
+
+    n = synthetic_star(s, s->xy, s->vertices, cx, cy, r, 0.7, 1.0, 0);
+
+    /*
+    * Leave the shell at its first vertex, run in to a spike near
+    * the centre and back to the same vertex, then carry on round.
+    * The spike stays inside the inner 0.4 of the radius, which
+    * the shell never comes within. It goes out on the side the
+    * shell arrives from and back on the side it leaves by, so
+    * the two passes through the vertex touch without crossing.
+    */
+    if (selftouch)
+    {
+        double a = atan2(s->xy[1] - cy, s->xy[0] - cx);
+        double spike[6];
+        spike[0] = cx + 0.3 * r * cos(a - 0.1);
+        spike[1] = cy + 0.3 * r * sin(a - 0.1);
+        spike[2] = cx + 0.3 * r * cos(a + 0.1);
+        spike[3] = cy + 0.3 * r * sin(a + 0.1);
+        spike[4] = s->xy[0];
+        spike[5] = s->xy[1];
+        memcpy(s->xy + 2 * n, spike, sizeof(spike));
+        n += 3;
+    }
+    shell = GEOSGeom_createLinearRing_r(s->ctx, synthetic_coords(s, n));
+
+    if (holes)
+    {
+        unsigned int nhole = s->vertices / 2 < 3 ? 3 : s->vertices / 2;
+        n = synthetic_star(s, s->xy, nhole, cx, cy, r, 0.2, 0.4, 1);
+        hole = GEOSGeom_createLinearRing_r(s->ctx, synthetic_coords(s, n));
+    }
+    return GEOSGeom_createPolygon_r(s->ctx, shell, hole ? &hole : NULL, hole ? 1 : 0);
+}
+
+static GEOSGeometry*
+synthetic_walk(gp_synthetic* s)
+{
+    unsigned int i;
+    double x = s->extent * random_double(&s->rng);
+    double y = s->extent * random_double(&s->rng);
+    double heading = 2.0 * M_PI * random_double(&s->rng);
+    double step = SYNTHETIC_CELL / s->vertices;
+    for (i = 0; i < s->vertices; i++)
+    {
+        s->xy[2 * i] = x;
+        s->xy[2 * i + 1] = y;
+        heading += 0.5 * random_normal(&s->rng);
+        x += step * cos(heading);
+        y += step * sin(heading);
+    }
+    return GEOSGeom_createLineString_r(s->ctx, synthetic_coords(s, s->vertices));
+}
+
+static int
+synthetic_points(gp_synthetic* s, const char* kind, uint64_t count, GEOSGeometryList* geoms)
+{
+    uint64_t i;
+    if (strcmp(kind, "uniform") == 0)
+    {
+        for (i = 0; i < count; i++)
+        {
+            double x = s->extent * random_double(&s->rng);
+            double y = s->extent * random_double(&s->rng);
+            geomlist_push(geoms, synthetic_point(s, x, y));
+        }
+    }
+    else if (strcmp(kind, "clustered") == 0)
+    {
+        uint64_t nclusters = (count + SYNTHETIC_CLUSTER_SIZE - 1) / SYNTHETIC_CLUSTER_SIZE;
+        double sigma = 0.1 * s->extent / sqrt((double)nclusters);
+        double cx = 0.0, cy = 0.0;
+        for (i = 0; i < count; i++)
+        {
+            if (i % SYNTHETIC_CLUSTER_SIZE == 0)
+            {
+                cx = s->extent * random_double(&s->rng);
+                cy = s->extent * random_double(&s->rng);
+            }
+            geomlist_push(geoms, synthetic_point(s,
+                cx + sigma * random_normal(&s->rng),
+                cy + sigma * random_normal(&s->rng)));
+        }
+    }
+    else if (strcmp(kind, "grid") == 0)
+    {
+        uint64_t side = (uint64_t)ceil(sqrt((double)count));
+        double step = s->extent / (side ? side : 1);
+        for (i = 0; i < count; i++)
+        {
+            geomlist_push(geoms, synthetic_point(s,
+                step * (i % side + 0.5),
+                step * (i / side + 0.5)));
+        }
+    }
+    else
+    {
+        return 0;
+    }
+    return 1;
+}
+
+int
+synthetic_generate(GEOSContextHandle_t ctx, const char* name, GEOSGeometryList* geoms)
+{
+    char kind[MAXSTRLEN];
+    unsigned long long count = 0;
+    unsigned int vertices = SYNTHETIC_DEFAULT_VERTICES;
+    unsigned long long seed = SYNTHETIC_DEFAULT_SEED;
+    gp_synthetic s;
+    uint64_t i;
+    int ok = 1;
+
+    if (!synthetic_is_name(name) ||
+        sscanf(name + strlen(SYNTHETIC_PREFIX), "%1023[^:]:%llu:%u:%llu",
+               kind, &count, &vertices, &seed) < 2)
+    {
+        fprintf(stderr, "invalid synthetic dataset name '%s'\n", name);
+        return -1;
+    }
+    if (vertices < 3)
+        vertices = 3;
+
+    /* Geometries are not tied to the context that made them */
+    s.ctx = ctx ? ctx : GEOS_init_r();
+    s.rng = seed;
+    s.extent = SYNTHETIC_CELL * sqrt((double)count);
+    s.vertices = vertices;
+    /* Room for a shell, its closing vertex and a spike */
+    s.xy = malloc(sizeof(double) * 2 * (vertices + 4));
+
+    if (!synthetic_points(&s, kind, count, geoms))
+    {
+        for (i = 0; i < count && ok; i++)
+        {
+            if (strcmp(kind, "walk") == 0)
+                geomlist_push(geoms, synthetic_walk(&s));
+            else if (strcmp(kind, "polygon") == 0)
+                geomlist_push(geoms, synthetic_polygon(&s, 0, 0));
+            else if (strcmp(kind, "holes") == 0)
+                geomlist_push(geoms, synthetic_polygon(&s, 1, 0));
+            else if (strcmp(kind, "selftouch") == 0)
+                geomlist_push(geoms, synthetic_polygon(&s, 0, 1));
+            else
+                ok = 0;
+        }
+    }
+
+    free(s.xy);
+    if (!ctx)
+        GEOS_finish_r(s.ctx);
+    if (!ok)
+    {
+        fprintf(stderr, "unknown synthetic dataset kind '%s'\n", kind);
+        return -1;
+    }
+    return 0;
+}
@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "geos_perf.h"
 
@@ -38,13 +39,49 @@ static void cleanup(void)
     GEOSGeom_destroy(australia);
 }
 
+/*************************************************************************
+* THREADED VERSION
+*/
+
+/* Each thread reads its own copy of the australia boundary */
+static void* thread_setup(GEOSContextHandle_t ctx)
+{
+    GEOSGeometryList* australia_file = malloc(sizeof(GEOSGeometryList));
+    geomlist_init(australia_file);
+    read_data_file_r(ctx, "australia.wkt.gz", australia_file);
+    return australia_file;
+}
+
+static void thread_run(GEOSContextHandle_t ctx, void* state)
+{
+    GEOSGeometryList* australia_file = (GEOSGeometryList*)state;
+    if (geomlist_size(australia_file) > 0)
+    {
+        GEOSGeometry* buffer = GEOSBuffer_r(ctx,
+            geomlist_get(australia_file, 0), 0.0001, 24);
+        GEOSGeom_destroy_r(ctx, buffer);
+    }
+}
+
+static void thread_cleanup(GEOSContextHandle_t ctx, void* state)
+{
+    geomlist_free_r(ctx, (GEOSGeometryList*)state);
+    free(state);
+}
+
 /*************************************************************************
 * CONFIGURATION CALLBACK FUNCTION
 */
 
+/* Files the runner checks for before setup */
+static const char* const data_files[] = {
+    "australia.wkt.gz",
+    NULL
+};
+
 gp_test config_buffer_australia(void)
 {
-    gp_test test;
+    gp_test test = {0};
     test.name = "Australia buffer";
     test.description =
         "Load a complex boundary of Australia with many"
@@ -53,7 +90,12 @@ gp_test config_buffer_australia(void)
     test.func_setup = setup;
     test.func_run = run;
     test.func_cleanup = cleanup;
-    test.count = 1;
+    test.func_thread_setup = thread_setup;
+    test.func_thread_run = thread_run;
+    test.func_thread_cleanup = thread_cleanup;
+    test.count_min = 3;
+    test.count_max = 20;
+    test.data_files = data_files;
     return test;
 }
 
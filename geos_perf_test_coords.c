@@ -0,0 +1,132 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "geos_perf.h"
+
+/*************************************************************************
+* PERFORMANCE TEST
+*
+* Geometry construction from flat coordinate arrays, and
+* extraction back into them, without going through text.
+* The method parameter picks the GEOS calls, so sweeping
+* it compares per-ordinate setters and getters with the
+* XY calls and the bulk copies.
+*/
+
+/* Variables where data lives between the setup/run/cleanup stages */
+static const GEOSGeometryList* dataset;
+static gp_coord_store store;
+static int method;
+
+/* Sweep with -p method=setters,xy,buffer,arrays */
+static gp_param params[] = {
+    {"data", "watersheds.wkt.gz", NULL},
+    {"method", "setters", NULL},
+    {NULL, NULL, NULL}
+};
+
+/* Pick the method, skipping the test without it, and load the dataset into the store */
+static int
+store_setup(void)
+{
+    const char* name = param_get(params, "method");
+    method = coords_method(name);
+    if (method < 0)
+    {
+        skip_report("coordinate method '%s' is unknown or unavailable", name);
+        return 0;
+    }
+
+    dataset = dataset_acquire(param_get(params, "data"));
+    if (!dataset)
+        return 0;
+    if (!coords_from_geoms(dataset, &store))
+    {
+        coords_free(&store);
+        dataset_release(dataset);
+        dataset = NULL;
+        skip_report("unsupported geometry type");
+        return 0;
+    }
+    work_report(store.nfeatures, store.ncoords * 2 * sizeof(double));
+    return 1;
+}
+
+static void build_setup(void)
+{
+    if (!store_setup())
+        return;
+    dataset_release(dataset);
+    dataset = NULL;
+}
+
+/* Build every feature from the store and throw it away */
+static void build_run(void)
+{
+    size_t i;
+    for (i = 0; i < store.nfeatures; i++)
+    {
+        GEOSGeometry* g = coords_build(&store, i, method);
+        GEOSGeom_destroy(g);
+    }
+}
+
+static void build_cleanup(void)
+{
+    coords_free(&store);
+}
+
+static void extract_setup(void)
+{
+    store_setup();
+}
+
+/* Copy the coordinates of every feature back into the store */
+static void extract_run(void)
+{
+    size_t i, offset = 0;
+    for (i = 0; i < geomlist_size(dataset); i++)
+        offset += coords_extract(geomlist_get(dataset, i), &store, offset, method);
+}
+
+static void extract_cleanup(void)
+{
+    coords_free(&store);
+    dataset_release(dataset);
+}
+
+/*************************************************************************
+* CONFIGURATION CALLBACK FUNCTIONS
+*/
+
+gp_test config_coords_build(void)
+{
+    gp_test test = {0};
+    test.name = "Coordinate build";
+    test.description =
+        "Build every feature of a dataset from flat coordinate "
+        "arrays, using the GEOS calls picked by the method.";
+    test.func_setup = build_setup;
+    test.func_run = build_run;
+    test.func_cleanup = build_cleanup;
+    test.params = params;
+    test.count_min = 10;
+    test.count_max = 100;
+    return test;
+}
+
+gp_test config_coords_extract(void)
+{
+    gp_test test = {0};
+    test.name = "Coordinate extract";
+    test.description =
+        "Copy the coordinates of every feature of a dataset into "
+        "flat arrays, using the GEOS calls picked by the method.";
+    test.func_setup = extract_setup;
+    test.func_run = extract_run;
+    test.func_cleanup = extract_cleanup;
+    test.params = params;
+    test.count_min = 10;
+    test.count_max = 100;
+    return test;
+}
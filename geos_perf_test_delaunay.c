@@ -44,9 +44,15 @@ cleanup(void)
 * CONFIGURATION CALLBACK FUNCTION
 */
 
+/* Files the runner checks for before setup */
+static const char* const data_files[] = {
+    "multipoint_random_1000.wkt.gz",
+    NULL
+};
+
 gp_test config_delaunay(void)
 {
-    gp_test test;
+    gp_test test = {0};
     test.name = "Delaunay";
     test.description =
         "Load a multipoint, and build a delaunay triangulation"
@@ -54,7 +60,9 @@ gp_test config_delaunay(void)
     test.func_setup = setup;
     test.func_run = run;
     test.func_cleanup = cleanup;
-    test.count = 2000;
+    test.count_min = 2000;
+    test.count_max = 20000;
+    test.data_files = data_files;
     return test;
 }
 
@@ -0,0 +1,413 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+
+#include "geos_perf.h"
+
+/*************************************************************************
+* PERFORMANCE TEST
+*
+* Distances to polygons. "Nearest watershed" finds the watershed
+* nearest to each of a set of random points, with an STRtree and
+* GEOSSTRtree_nearest_generic called back with the exact distance
+* between the point and each candidate, instead of the envelope
+* distance that GEOSSTRtree_nearest uses for points. "Watershed
+* k-nearest" finds the k nearest, by repeating the search with the
+* watersheds found so far pushed out to an infinite distance, as
+* the C API has no k-nearest search of its own. "Watershed distance"
+* times the distance between a sample of watersheds and targets,
+* points or other watersheds, with GEOSDistance, GEOSDistanceIndexed,
+* GEOSPreparedDistance or GEOSPreparedNearestPoints.
+*/
+
+/* GEOS <= 3.5 lacks GEOSSTRtree_nearest_generic() */
+#if GEOS_VERSION_CMP > 305
+
+#define DISTANCE_SEED 1
+
+enum {
+    DISTANCE_EXACT,
+    DISTANCE_INDEXED,
+    DISTANCE_PREPARED,
+    DISTANCE_NEARESTPOINTS
+};
+
+static const char* method_names[] = {
+    "exact", "indexed", "prepared", "nearestpoints", NULL
+};
+
+/* Variables where data lives between the setup/run/cleanup stages */
+static const GEOSGeometryList* watersheds;
+static GEOSGeometryList probes;
+static GEOSSTRtree* tree;
+static int method;
+static size_t k;
+static const GEOSGeometry** found;
+static size_t nfound;
+static size_t npolygons;
+static const GEOSGeometry** polygons;
+static const GEOSPreparedGeometry** prepared;
+static size_t ntargets;
+static const GEOSGeometry** targets;
+
+/* Sweep with -p distance=exact,indexed */
+static gp_param nearest_params[] = {
+    {"distance", "exact", NULL},
+    {"queries", "1000", NULL},
+    {"node_capacity", "10", NULL},
+    {NULL, NULL, NULL}
+};
+
+/* and with -p k=1,5,10,50 */
+static gp_param knn_params[] = {
+    {"distance", "exact", NULL},
+    {"queries", "200", NULL},
+    {"k", "5", NULL},
+    {"node_capacity", "10", NULL},
+    {NULL, NULL, NULL}
+};
+
+/* and with -p method=exact,indexed,prepared,nearestpoints -p target=point,polygon */
+static gp_param distance_params[] = {
+    {"method", "exact", NULL},
+    {"target", "point", NULL},
+    {"polygons", "64", NULL},
+    {"targets", "16", NULL},
+    {NULL, NULL, NULL}
+};
+
+static int
+method_available(int m)
+{
+    switch (m)
+    {
+        case DISTANCE_EXACT:
+            return 1;
+        case DISTANCE_INDEXED:
+            return GEOS_VERSION_CMP >= 307;
+        case DISTANCE_PREPARED:
+        case DISTANCE_NEARESTPOINTS:
+            return GEOS_VERSION_CMP >= 309;
+    }
+    return 0;
+}
+
+/* Method by name, skipping the test when it is unknown or unavailable */
+static int
+method_find(const char* name, int last)
+{
+    int m;
+    for (m = 0; m <= last; m++)
+    {
+        if (strcmp(name, method_names[m]) == 0 && method_available(m))
+            return m;
+    }
+    skip_report("distance method '%s' is unknown or unavailable", name);
+    return -1;
+}
+
+static int
+geom_distance(const GEOSGeometry* g1, const GEOSGeometry* g2, double* distance)
+{
+#if GEOS_VERSION_CMP >= 307
+    if (method == DISTANCE_INDEXED)
+        return GEOSDistanceIndexed(g1, g2, distance);
+#endif
+    return GEOSDistance(g1, g2, distance);
+}
+
+/*
+* Distance between the query point and a watershed, or infinity
+* for the watersheds the k-nearest search has already found.
+*/
+static int
+distance_callback(const void* item1, const void* item2, double* distance, void* userdata)
+{
+    size_t i;
+    for (i = 0; i < nfound; i++)
+    {
+        if (item1 == found[i] || item2 == found[i])
+        {
+            *distance = DBL_MAX;
+            return 1;
+        }
+    }
+    return geom_distance((const GEOSGeometry*)item1, (const GEOSGeometry*)item2, distance);
+}
+
+/* Random points over the extent of the watersheds */
+static void
+probes_create(size_t n)
+{
+    size_t i;
+    uint64_t rng = DISTANCE_SEED;
+    double xmin, ymin, xmax, ymax;
+    geomlist_extent(watersheds, &xmin, &ymin, &xmax, &ymax);
+    geomlist_init(&probes);
+    for (i = 0; i < n; i++)
+    {
+        double x = xmin + random_double(&rng) * (xmax - xmin);
+        double y = ymin + random_double(&rng) * (ymax - ymin);
+        geomlist_push(&probes, createPointFromXY(x, y));
+    }
+}
+
+/*************************************************************************
+* Nearest and k-nearest watersheds
+*/
+
+static int
+tree_setup(gp_param* params)
+{
+    size_t i, node_capacity = param_node_capacity(params);
+    if (!node_capacity)
+        return 0;
+    method = method_find(param_get(params, "distance"), DISTANCE_INDEXED);
+    if (method < 0)
+        return 0;
+    watersheds = dataset_acquire("watersheds.wkt.gz");
+    if (!watersheds)
+        return 0;
+    probes_create((size_t)param_double(params, "queries"));
+    tree = GEOSSTRtree_create(node_capacity);
+    for (i = 0; i < geomlist_size(watersheds); i++)
+    {
+        const GEOSGeometry* geom = geomlist_get(watersheds, i);
+        GEOSSTRtree_insert(tree, geom, (void*)geom);
+    }
+    nfound = 0;
+    return 1;
+}
+
+static void
+nearest_setup(void)
+{
+    if (!tree_setup(nearest_params))
+        return;
+    k = 1;
+    found = malloc(sizeof(GEOSGeometry*) * (k + 1));
+    work_report(geomlist_size(&probes), 0);
+}
+
+static void
+knn_setup(void)
+{
+    if (!tree_setup(knn_params))
+        return;
+    k = (size_t)param_double(knn_params, "k");
+    if (k < 1)
+        k = 1;
+    if (k > geomlist_size(watersheds))
+        k = geomlist_size(watersheds);
+    found = malloc(sizeof(GEOSGeometry*) * (k + 1));
+    work_report(geomlist_size(&probes), 0);
+}
+
+/* For each point, find the k nearest watersheds in order */
+static void
+nearest_run(void)
+{
+    size_t i;
+    for (i = 0; i < geomlist_size(&probes); i++)
+    {
+        const GEOSGeometry* pt = geomlist_get(&probes, i);
+        nfound = 0;
+        while (nfound < k)
+        {
+            const GEOSGeometry* nearest = GEOSSTRtree_nearest_generic(
+                tree, pt, pt, distance_callback, NULL);
+            if (!nearest)
+                break;
+            found[nfound++] = nearest;
+        }
+    }
+    nfound = 0;
+}
+
+static void
+nearest_cleanup(void)
+{
+    free(found);
+    found = NULL;
+    GEOSSTRtree_destroy(tree);
+    tree = NULL;
+    geomlist_free(&probes);
+    dataset_release(watersheds);
+}
+
+/*************************************************************************
+* Watershed distance
+*/
+
+static void
+distance_setup(void)
+{
+    size_t i, n;
+    const char* target = param_get(distance_params, "target");
+    int polygon_targets = strcmp(target, "polygon") == 0;
+    if (!polygon_targets && strcmp(target, "point") != 0)
+    {
+        skip_report("unknown target '%s', use point or polygon", target);
+        return;
+    }
+    method = method_find(param_get(distance_params, "method"), DISTANCE_NEARESTPOINTS);
+    if (method < 0)
+        return;
+    watersheds = dataset_acquire("watersheds.wkt.gz");
+    if (!watersheds)
+        return;
+    npolygons = (size_t)param_double(distance_params, "polygons");
+    ntargets = (size_t)param_double(distance_params, "targets");
+    n = geomlist_size(watersheds);
+    if (npolygons < 1 || npolygons > n)
+        npolygons = n;
+    if (ntargets < 1)
+        ntargets = 1;
+    if (polygon_targets && ntargets > n)
+        ntargets = n;
+
+    /* A sample spread over the file, and targets spread over the extent */
+    polygons = malloc(sizeof(GEOSGeometry*) * npolygons);
+    for (i = 0; i < npolygons; i++)
+        polygons[i] = geomlist_get(watersheds, i * n / npolygons);
+    probes_create(polygon_targets ? 0 : ntargets);
+    targets = malloc(sizeof(GEOSGeometry*) * ntargets);
+    for (i = 0; i < ntargets; i++)
+    {
+        targets[i] = polygon_targets ?
+            geomlist_get(watersheds, (i * n / ntargets + n / (2 * ntargets)) % n) :
+            geomlist_get(&probes, i);
+    }
+
+    /* Prepared once, as a cache would hold them */
+    prepared = calloc(npolygons, sizeof(GEOSPreparedGeometry*));
+    if (method == DISTANCE_PREPARED || method == DISTANCE_NEARESTPOINTS)
+    {
+        for (i = 0; i < npolygons; i++)
+            prepared[i] = GEOSPrepare(polygons[i]);
+    }
+    work_report(npolygons * ntargets, 0);
+}
+
+/* Distance from every sampled watershed to every target */
+static void
+distance_run(void)
+{
+    size_t i, j;
+    double distance;
+    for (i = 0; i < npolygons; i++)
+    {
+        for (j = 0; j < ntargets; j++)
+        {
+            switch (method)
+            {
+                case DISTANCE_EXACT:
+                case DISTANCE_INDEXED:
+                    geom_distance(polygons[i], targets[j], &distance);
+                    break;
+#if GEOS_VERSION_CMP >= 309
+                case DISTANCE_PREPARED:
+                    GEOSPreparedDistance(prepared[i], targets[j], &distance);
+                    break;
+                case DISTANCE_NEARESTPOINTS:
+                {
+                    GEOSCoordSequence* cs = GEOSPreparedNearestPoints(prepared[i], targets[j]);
+                    GEOSCoordSeq_destroy(cs);
+                    break;
+                }
+#endif
+            }
+        }
+    }
+}
+
+static void
+distance_cleanup(void)
+{
+    size_t i;
+    for (i = 0; i < npolygons; i++)
+    {
+        if (prepared[i])
+            GEOSPreparedGeom_destroy(prepared[i]);
+    }
+    free(prepared);
+    free(polygons);
+    free(targets);
+    prepared = NULL;
+    polygons = NULL;
+    targets = NULL;
+    geomlist_free(&probes);
+    dataset_release(watersheds);
+}
+
+/*************************************************************************
+* CONFIGURATION CALLBACK FUNCTIONS
+*/
+
+/* Files the runner checks for before setup */
+static const char* const data_files[] = {
+    "watersheds.wkt.gz",
+    NULL
+};
+
+gp_test config_nearest_watershed(void)
+{
+    gp_test test = {0};
+    test.name = "Nearest watershed";
+    test.description =
+        "Find the nearest watershed to random points, with an "
+        "STRtree searched by the exact distance to each "
+        "candidate.";
+    test.func_setup = nearest_setup;
+    test.func_run = nearest_run;
+    test.func_cleanup = nearest_cleanup;
+    test.params = nearest_params;
+    test.count_min = 5;
+    test.count_max = 50;
+    test.data_files = data_files;
+    return test;
+}
+
+gp_test config_knn_watershed(void)
+{
+    gp_test test = {0};
+    test.name = "Watershed k-nearest";
+    test.description =
+        "Find the k nearest watersheds to random points, with "
+        "repeated STRtree searches by exact distance.";
+    test.func_setup = knn_setup;
+    test.func_run = nearest_run;
+    test.func_cleanup = nearest_cleanup;
+    test.params = knn_params;
+    test.count_min = 5;
+    test.count_max = 50;
+    test.data_files = data_files;
+    return test;
+}
+
+gp_test config_distance_watershed(void)
+{
+    gp_test test = {0};
+    test.name = "Watershed distance";
+    test.description =
+        "Compute the distance from a sample of watersheds to "
+        "points or other watersheds, with plain, indexed or "
+        "prepared distance.";
+    test.func_setup = distance_setup;
+    test.func_run = distance_run;
+    test.func_cleanup = distance_cleanup;
+    test.params = distance_params;
+    test.count_min = 5;
+    test.count_max = 50;
+    test.data_files = data_files;
+    return test;
+}
+
+#else
+
+GEOS_PERF_SKIP(config_nearest_watershed);
+GEOS_PERF_SKIP(config_knn_watershed);
+GEOS_PERF_SKIP(config_distance_watershed);
+
+#endif
@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "geos_perf.h"
 
@@ -7,7 +8,7 @@
 */
 
 /* Variables where data lives between the setup/run/cleanup stages */
-static GEOSGeometryList watersheds;
+static const GEOSGeometryList* watersheds;
 static GEOSGeometryList watersheds_buffered;
 static GEOSSTRtree* tree;
 
@@ -16,22 +17,23 @@ static GEOSSTRtree* tree;
 static void setup(void)
 {
     size_t i;
-    geomlist_init(&watersheds);
+    watersheds = dataset_acquire("watersheds.wkt.gz");
+    if (!watersheds)
+        return;
     geomlist_init(&watersheds_buffered);
-    read_data_file("watersheds.wkt.gz", &watersheds);
 
     /* Calculate buffers of the polygons */
-    for (i = 0; i < geomlist_size(&watersheds); i++)
+    for (i = 0; i < geomlist_size(watersheds); i++)
     {
-        const GEOSGeometry* geom = geomlist_get(&watersheds, i);
+        const GEOSGeometry* geom = geomlist_get(watersheds, i);
         geomlist_push(&watersheds_buffered, GEOSBuffer(geom, 100.0, 16));
     }
 
     /* Populate tree with watersheds */
     tree = GEOSSTRtree_create(10);
-    for (i = 0; i < geomlist_size(&watersheds); i++)
+    for (i = 0; i < geomlist_size(watersheds); i++)
     {
-        const GEOSGeometry* geom = geomlist_get(&watersheds, i);
+        const GEOSGeometry* geom = geomlist_get(watersheds, i);
         GEOSSTRtree_insert(tree, geom, (void*)geom);
     }
 
@@ -78,16 +80,86 @@ static void cleanup(void)
 {
     GEOSSTRtree_destroy(tree);
     geomlist_free(&watersheds_buffered);
-    geomlist_free(&watersheds);
+    dataset_release(watersheds);
+}
+
+/*************************************************************************
+* THREADED VERSION
+*/
+
+/* Per-thread copy of the data and tree */
+typedef struct {
+    GEOSGeometryList watersheds;
+    GEOSGeometryList watersheds_buffered;
+    GEOSSTRtree* tree;
+} thread_state;
+
+static void* thread_setup(GEOSContextHandle_t ctx)
+{
+    size_t i;
+    thread_state* state = malloc(sizeof(thread_state));
+    geomlist_init(&state->watersheds);
+    geomlist_init(&state->watersheds_buffered);
+    read_data_file_r(ctx, "watersheds.wkt.gz", &state->watersheds);
+
+    for (i = 0; i < geomlist_size(&state->watersheds); i++)
+    {
+        const GEOSGeometry* geom = geomlist_get(&state->watersheds, i);
+        geomlist_push(&state->watersheds_buffered, GEOSBuffer_r(ctx, geom, 100.0, 16));
+    }
+
+    state->tree = GEOSSTRtree_create_r(ctx, 10);
+    for (i = 0; i < geomlist_size(&state->watersheds); i++)
+    {
+        const GEOSGeometry* geom = geomlist_get(&state->watersheds, i);
+        GEOSSTRtree_insert_r(ctx, state->tree, geom, (void*)geom);
+    }
+    return state;
+}
+
+static void thread_run(GEOSContextHandle_t ctx, void* data)
+{
+    size_t i, j;
+    thread_state* state = (thread_state*)data;
+    GEOSGeometryList query_result;
+    for (i = 0; i < geomlist_size(&state->watersheds_buffered); i++)
+    {
+        const GEOSGeometry* bufshed = geomlist_get(&state->watersheds_buffered, i);
+        geomlist_init(&query_result);
+        GEOSSTRtree_query_r(ctx, state->tree, bufshed, tree_callback, &query_result);
+
+        for (j = 0; j < geomlist_size(&query_result); j++)
+        {
+            const GEOSGeometry* shed = geomlist_get(&query_result, j);
+            GEOSGeometry* inter = GEOSIntersection_r(ctx, shed, bufshed);
+            GEOSGeom_destroy_r(ctx, inter);
+        }
+        geomlist_release(&query_result);
+    }
+}
+
+static void thread_cleanup(GEOSContextHandle_t ctx, void* data)
+{
+    thread_state* state = (thread_state*)data;
+    GEOSSTRtree_destroy_r(ctx, state->tree);
+    geomlist_free_r(ctx, &state->watersheds_buffered);
+    geomlist_free_r(ctx, &state->watersheds);
+    free(state);
 }
 
 /*************************************************************************
 * CONFIGURATION CALLBACK FUNCTION
 */
 
+/* Files the runner checks for before setup */
+static const char* const data_files[] = {
+    "watersheds.wkt.gz",
+    NULL
+};
+
 gp_test config_intersection(void)
 {
-    gp_test test;
+    gp_test test = {0};
     test.name = "Watershed intersections";
     test.description =
         "Load and create an STRtree for the watersheds."
@@ -97,7 +169,12 @@ gp_test config_intersection(void)
     test.func_setup = setup;
     test.func_run = run;
     test.func_cleanup = cleanup;
-    test.count = 1;
+    test.func_thread_setup = thread_setup;
+    test.func_thread_run = thread_run;
+    test.func_thread_cleanup = thread_cleanup;
+    test.count_min = 3;
+    test.count_max = 30;
+    test.data_files = data_files;
     return test;
 }
 
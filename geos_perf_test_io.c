@@ -0,0 +1,445 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "geos_perf.h"
+
+/*************************************************************************
+* PERFORMANCE TEST
+*
+* Reader and writer throughput for each serialization format.
+* The read tests serialize the whole dataset in setup and time
+* parsing it back, the write tests time serializing the dataset.
+* Both report the features and bytes of one pass, so the runner
+* can give features/s and MB/s. The tests all share the state
+* below, as only one test runs at a time.
+*/
+
+enum {
+    FORMAT_WKT,
+    FORMAT_WKB,
+    FORMAT_HEX,
+    FORMAT_GEOJSON
+};
+
+/* Variables where data lives between the setup/run/cleanup stages */
+static int format;
+static const GEOSGeometryList* shared;
+static GEOSGeometryList geoms;
+static unsigned char** buffers;
+static size_t* sizes;
+static size_t nbuffers;
+
+static GEOSWKTReader* wkt_reader;
+static GEOSWKTWriter* wkt_writer;
+static GEOSWKBReader* wkb_reader;
+static GEOSWKBWriter* wkb_writer;
+#if GEOS_VERSION_CMP >= 310
+static GEOSGeoJSONReader* json_reader;
+static GEOSGeoJSONWriter* json_writer;
+#endif
+
+/* Sweep -p data=points_random_10000.wkt.gz or -p dims=3 */
+static gp_param params[] = {
+    {"data", "watersheds.wkt.gz", NULL},
+    {"dims", "2", NULL},
+    {NULL, NULL, NULL}
+};
+
+/* WKB also comes in hex, sweep with -p encoding=binary,hex */
+static gp_param wkb_params[] = {
+    {"data", "watersheds.wkt.gz", NULL},
+    {"dims", "2", NULL},
+    {"encoding", "binary", NULL},
+    {NULL, NULL, NULL}
+};
+
+/*
+* The data files are all 2D, so 3D input is made by copying every
+* coordinate sequence into one with a Z of zero, the way
+* geos_perf_coords.c builds geometries from coordinates.
+*/
+static GEOSCoordSequence*
+seq_add_z(const GEOSCoordSequence* cs)
+{
+    unsigned int i, n;
+    GEOSCoordSequence* out;
+    GEOSCoordSeq_getSize(cs, &n);
+    out = GEOSCoordSeq_create(n, 3);
+    for (i = 0; i < n; i++)
+    {
+        double x, y;
+        GEOSCoordSeq_getX(cs, i, &x);
+        GEOSCoordSeq_getY(cs, i, &y);
+        GEOSCoordSeq_setX(out, i, x);
+        GEOSCoordSeq_setY(out, i, y);
+        GEOSCoordSeq_setZ(out, i, 0.0);
+    }
+    return out;
+}
+
+static GEOSGeometry*
+ring_add_z(const GEOSGeometry* ring)
+{
+    return GEOSGeom_createLinearRing(seq_add_z(GEOSGeom_getCoordSeq(ring)));
+}
+
+static GEOSGeometry*
+geom_add_z(const GEOSGeometry* g)
+{
+    int i, n;
+    GEOSGeometry** parts;
+    GEOSGeometry* out;
+    int type = GEOSGeomTypeId(g);
+
+    switch (type)
+    {
+        case GEOS_POINT:
+            return GEOSGeom_createPoint(seq_add_z(GEOSGeom_getCoordSeq(g)));
+        case GEOS_LINESTRING:
+            return GEOSGeom_createLineString(seq_add_z(GEOSGeom_getCoordSeq(g)));
+        case GEOS_LINEARRING:
+            return ring_add_z(g);
+        case GEOS_POLYGON:
+            if (GEOSisEmpty(g))
+                return GEOSGeom_createEmptyPolygon();
+            n = GEOSGetNumInteriorRings(g);
+            parts = n > 0 ? malloc(sizeof(GEOSGeometry*) * n) : NULL;
+            for (i = 0; i < n; i++)
+                parts[i] = ring_add_z(GEOSGetInteriorRingN(g, i));
+            out = GEOSGeom_createPolygon(ring_add_z(GEOSGetExteriorRing(g)), parts, (unsigned int)n);
+            free(parts);
+            return out;
+        case GEOS_MULTIPOINT:
+        case GEOS_MULTILINESTRING:
+        case GEOS_MULTIPOLYGON:
+        case GEOS_GEOMETRYCOLLECTION:
+            n = GEOSGetNumGeometries(g);
+            parts = malloc(sizeof(GEOSGeometry*) * (n + 1));
+            for (i = 0; i < n; i++)
+                parts[i] = geom_add_z(GEOSGetGeometryN(g, i));
+            out = GEOSGeom_createCollection(type, parts, (unsigned int)n);
+            free(parts);
+            return out;
+    }
+    return NULL;
+}
+
+/* The dataset to serialize, shared in 2D or made 3D */
+static const GEOSGeometryList*
+input_load(const gp_param* p)
+{
+    size_t i;
+    const char* data = param_get(p, "data");
+    int dims = (int)param_double(p, "dims");
+
+    shared = dataset_acquire(data);
+    if (!shared || dims < 3)
+        return shared;
+
+    geomlist_init(&geoms);
+    for (i = 0; i < geomlist_size(shared); i++)
+    {
+        GEOSGeometry* g = geom_add_z(geomlist_get(shared, i));
+        if (!g)
+        {
+            skip_report("cannot make feature %zu of %s 3D", i, data);
+            geomlist_free(&geoms);
+            dataset_release(shared);
+            shared = NULL;
+            return NULL;
+        }
+        geomlist_push(&geoms, g);
+    }
+    dataset_release(shared);
+    shared = NULL;
+    return &geoms;
+}
+
+static void
+input_free(void)
+{
+    if (shared)
+        dataset_release(shared);
+    else
+        geomlist_free(&geoms);
+    shared = NULL;
+}
+
+static void
+io_create(const gp_param* p)
+{
+    int dims = (int)param_double(p, "dims");
+    wkt_reader = GEOSWKTReader_create();
+    wkt_writer = GEOSWKTWriter_create();
+    GEOSWKTWriter_setOutputDimension(wkt_writer, dims);
+    wkb_reader = GEOSWKBReader_create();
+    wkb_writer = GEOSWKBWriter_create();
+    GEOSWKBWriter_setOutputDimension(wkb_writer, dims);
+#if GEOS_VERSION_CMP >= 310
+    json_reader = GEOSGeoJSONReader_create();
+    json_writer = GEOSGeoJSONWriter_create();
+#endif
+}
+
+static void
+io_destroy(void)
+{
+    GEOSWKTReader_destroy(wkt_reader);
+    GEOSWKTWriter_destroy(wkt_writer);
+    GEOSWKBReader_destroy(wkb_reader);
+    GEOSWKBWriter_destroy(wkb_writer);
+#if GEOS_VERSION_CMP >= 310
+    GEOSGeoJSONReader_destroy(json_reader);
+    GEOSGeoJSONWriter_destroy(json_writer);
+#endif
+}
+
+/* Serialize in the current format, to be freed with GEOSFree */
+static unsigned char*
+io_write(const GEOSGeometry* g, size_t* size)
+{
+    char* text = NULL;
+    switch (format)
+    {
+        case FORMAT_WKB:
+            return GEOSWKBWriter_write(wkb_writer, g, size);
+        case FORMAT_HEX:
+            return GEOSWKBWriter_writeHEX(wkb_writer, g, size);
+        case FORMAT_WKT:
+            text = GEOSWKTWriter_write(wkt_writer, g);
+            break;
+#if GEOS_VERSION_CMP >= 310
+        case FORMAT_GEOJSON:
+            text = GEOSGeoJSONWriter_writeGeometry(json_writer, g, -1);
+            break;
+#endif
+    }
+    *size = text ? strlen(text) : 0;
+    return (unsigned char*)text;
+}
+
+static GEOSGeometry*
+io_read(const unsigned char* buffer, size_t size)
+{
+    switch (format)
+    {
+        case FORMAT_WKB:
+            return GEOSWKBReader_read(wkb_reader, buffer, size);
+        case FORMAT_HEX:
+            return GEOSWKBReader_readHEX(wkb_reader, buffer, size);
+        case FORMAT_WKT:
+            return GEOSWKTReader_read(wkt_reader, (const char*)buffer);
+#if GEOS_VERSION_CMP >= 310
+        case FORMAT_GEOJSON:
+            return GEOSGeoJSONReader_readGeometry(json_reader, (const char*)buffer);
+#endif
+    }
+    return NULL;
+}
+
+/* Serialize the dataset in setup, so the run only parses */
+static void
+read_setup(const gp_param* p)
+{
+    size_t i, bytes = 0;
+    const GEOSGeometryList* input = input_load(p);
+    if (!input)
+        return;
+    io_create(p);
+    nbuffers = geomlist_size(input);
+    buffers = malloc(sizeof(unsigned char*) * nbuffers);
+    sizes = malloc(sizeof(size_t) * nbuffers);
+    for (i = 0; i < nbuffers; i++)
+    {
+        buffers[i] = io_write(geomlist_get(input, i), &sizes[i]);
+        bytes += sizes[i];
+    }
+    input_free();
+    work_report(nbuffers, bytes);
+}
+
+static void
+read_run(void)
+{
+    size_t i;
+    for (i = 0; i < nbuffers; i++)
+    {
+        GEOSGeometry* g = io_read(buffers[i], sizes[i]);
+        GEOSGeom_destroy(g);
+    }
+}
+
+static void
+read_cleanup(void)
+{
+    size_t i;
+    for (i = 0; i < nbuffers; i++)
+        GEOSFree(buffers[i]);
+    free(buffers);
+    free(sizes);
+    io_destroy();
+}
+
+/* Serialize once in setup to count the bytes each run writes */
+static const GEOSGeometryList* write_input;
+
+static void
+write_setup(const gp_param* p)
+{
+    size_t i, bytes = 0;
+    write_input = input_load(p);
+    if (!write_input)
+        return;
+    io_create(p);
+    for (i = 0; i < geomlist_size(write_input); i++)
+    {
+        size_t size;
+        GEOSFree(io_write(geomlist_get(write_input, i), &size));
+        bytes += size;
+    }
+    work_report(geomlist_size(write_input), bytes);
+}
+
+static void
+write_run(void)
+{
+    size_t i;
+    for (i = 0; i < geomlist_size(write_input); i++)
+    {
+        size_t size;
+        GEOSFree(io_write(geomlist_get(write_input, i), &size));
+    }
+}
+
+static void
+write_cleanup(void)
+{
+    input_free();
+    io_destroy();
+}
+
+static int
+wkb_format(void)
+{
+    const char* encoding = param_get(wkb_params, "encoding");
+    return strcmp(encoding, "hex") == 0 ? FORMAT_HEX : FORMAT_WKB;
+}
+
+static void wkt_read_setup(void)  { format = FORMAT_WKT; read_setup(params); }
+static void wkt_write_setup(void) { format = FORMAT_WKT; write_setup(params); }
+static void wkb_read_setup(void)  { format = wkb_format(); read_setup(wkb_params); }
+static void wkb_write_setup(void) { format = wkb_format(); write_setup(wkb_params); }
+#if GEOS_VERSION_CMP >= 310
+static void json_read_setup(void)  { format = FORMAT_GEOJSON; read_setup(params); }
+static void json_write_setup(void) { format = FORMAT_GEOJSON; write_setup(params); }
+#endif
+
+/*************************************************************************
+* CONFIGURATION CALLBACK FUNCTIONS
+*/
+
+gp_test config_wkt_read(void)
+{
+    gp_test test = {0};
+    test.name = "WKT read";
+    test.description =
+        "Parse every feature of a dataset from WKT. "
+        "Exercises the WKT reader.";
+    test.func_setup = wkt_read_setup;
+    test.func_run = read_run;
+    test.func_cleanup = read_cleanup;
+    test.params = params;
+    test.count_min = 3;
+    test.count_max = 30;
+    return test;
+}
+
+gp_test config_wkt_write(void)
+{
+    gp_test test = {0};
+    test.name = "WKT write";
+    test.description =
+        "Write every feature of a dataset as WKT. "
+        "Exercises the WKT writer and number formatting.";
+    test.func_setup = wkt_write_setup;
+    test.func_run = write_run;
+    test.func_cleanup = write_cleanup;
+    test.params = params;
+    test.count_min = 3;
+    test.count_max = 30;
+    return test;
+}
+
+gp_test config_wkb_read(void)
+{
+    gp_test test = {0};
+    test.name = "WKB read";
+    test.description =
+        "Parse every feature of a dataset from binary "
+        "or hex WKB. Exercises the WKB reader.";
+    test.func_setup = wkb_read_setup;
+    test.func_run = read_run;
+    test.func_cleanup = read_cleanup;
+    test.params = wkb_params;
+    test.count_min = 20;
+    test.count_max = 200;
+    return test;
+}
+
+gp_test config_wkb_write(void)
+{
+    gp_test test = {0};
+    test.name = "WKB write";
+    test.description =
+        "Write every feature of a dataset as binary "
+        "or hex WKB. Exercises the WKB writer.";
+    test.func_setup = wkb_write_setup;
+    test.func_run = write_run;
+    test.func_cleanup = write_cleanup;
+    test.params = wkb_params;
+    test.count_min = 20;
+    test.count_max = 200;
+    return test;
+}
+
+#if GEOS_VERSION_CMP >= 310
+
+gp_test config_geojson_read(void)
+{
+    gp_test test = {0};
+    test.name = "GeoJSON read";
+    test.description =
+        "Parse every feature of a dataset from GeoJSON. "
+        "Exercises the GeoJSON reader.";
+    test.func_setup = json_read_setup;
+    test.func_run = read_run;
+    test.func_cleanup = read_cleanup;
+    test.params = params;
+    test.count_min = 3;
+    test.count_max = 30;
+    return test;
+}
+
+gp_test config_geojson_write(void)
+{
+    gp_test test = {0};
+    test.name = "GeoJSON write";
+    test.description =
+        "Write every feature of a dataset as GeoJSON. "
+        "Exercises the GeoJSON writer.";
+    test.func_setup = json_write_setup;
+    test.func_run = write_run;
+    test.func_cleanup = write_cleanup;
+    test.params = params;
+    test.count_min = 3;
+    test.count_max = 30;
+    return test;
+}
+
+#else
+
+GEOS_PERF_SKIP(config_geojson_read);
+GEOS_PERF_SKIP(config_geojson_write);
+
+#endif
@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "geos_perf.h"
 
@@ -33,13 +34,45 @@ static void cleanup(void)
     GEOSGeom_destroy(australia);
 }
 
+/*************************************************************************
+* THREADED VERSION
+*/
+
+/* Each thread reads its own copy of the australia boundary */
+static void* thread_setup(GEOSContextHandle_t ctx)
+{
+    GEOSGeometryList* australia_file = malloc(sizeof(GEOSGeometryList));
+    geomlist_init(australia_file);
+    read_data_file_r(ctx, "australia.wkt.gz", australia_file);
+    return australia_file;
+}
+
+static void thread_run(GEOSContextHandle_t ctx, void* state)
+{
+    GEOSGeometryList* australia_file = (GEOSGeometryList*)state;
+    if (geomlist_size(australia_file) > 0)
+        GEOSisValid_r(ctx, geomlist_get(australia_file, 0));
+}
+
+static void thread_cleanup(GEOSContextHandle_t ctx, void* state)
+{
+    geomlist_free_r(ctx, (GEOSGeometryList*)state);
+    free(state);
+}
+
 /*************************************************************************
 * CONFIGURATION CALLBACK FUNCTION
 */
 
+/* Files the runner checks for before setup */
+static const char* const data_files[] = {
+    "australia.wkt.gz",
+    NULL
+};
+
 gp_test config_isvalid_australia(void)
 {
-    gp_test test;
+    gp_test test = {0};
     test.name = "Australia isValid";
     test.description =
         "Load a complex boundary of Australia with many"
@@ -48,7 +81,12 @@ gp_test config_isvalid_australia(void)
     test.func_setup = setup;
     test.func_run = run;
     test.func_cleanup = cleanup;
-    test.count = 4;
+    test.func_thread_setup = thread_setup;
+    test.func_thread_run = thread_run;
+    test.func_thread_cleanup = thread_cleanup;
+    test.count_min = 4;
+    test.count_max = 40;
+    test.data_files = data_files;
     return test;
 }
 
@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "geos_perf.h"
 
@@ -7,25 +8,24 @@
 */
 
 /* Variables where data lives between the setup/run/cleanup stages */
-static GEOSGeometryList watersheds;
+static const GEOSGeometryList* watersheds;
 
 /* Read any data we need, and create any structures */
 static void setup(void)
 {
-    /* Geometry list always must be initialized before use */
-    /* so the internal array is prepared, and counters zero'ed out */
-    geomlist_init(&watersheds);
-    /* Use utility function to read data file into geometry list */
-    read_data_file("watersheds.wkt.gz", &watersheds);
+    /* Shared read-only view of the watersheds, loaded once per process */
+    watersheds = dataset_acquire("watersheds.wkt.gz");
+    if (!watersheds)
+        return;
 }
 
 /* For each run, valid test each geometry in the collection */
 static void run(void)
 {
     size_t i;
-    for (i = 0; i < geomlist_size(&watersheds); i++)
+    for (i = 0; i < geomlist_size(watersheds); i++)
     {
-        const GEOSGeometry* g = geomlist_get(&watersheds, i);
+        const GEOSGeometry* g = geomlist_get(watersheds, i);
         char valid = GEOSisValid(g);
     }
 }
@@ -33,23 +33,64 @@ static void run(void)
 /* Clean up any remaining memory */
 static void cleanup(void)
 {
-    geomlist_free(&watersheds);
+    dataset_release(watersheds);
+}
+
+/*************************************************************************
+* THREADED VERSION
+*/
+
+/* Each thread reads its own copy of the watersheds */
+static void* thread_setup(GEOSContextHandle_t ctx)
+{
+    GEOSGeometryList* watersheds = malloc(sizeof(GEOSGeometryList));
+    geomlist_init(watersheds);
+    read_data_file_r(ctx, "watersheds.wkt.gz", watersheds);
+    return watersheds;
+}
+
+static void thread_run(GEOSContextHandle_t ctx, void* state)
+{
+    size_t i;
+    GEOSGeometryList* watersheds = (GEOSGeometryList*)state;
+    for (i = 0; i < geomlist_size(watersheds); i++)
+    {
+        const GEOSGeometry* g = geomlist_get(watersheds, i);
+        GEOSisValid_r(ctx, g);
+    }
+}
+
+static void thread_cleanup(GEOSContextHandle_t ctx, void* state)
+{
+    geomlist_free_r(ctx, (GEOSGeometryList*)state);
+    free(state);
 }
 
 /*************************************************************************
 * CONFIGURATION CALLBACK FUNCTION
 */
 
+/* Files the runner checks for before setup */
+static const char* const data_files[] = {
+    "watersheds.wkt.gz",
+    NULL
+};
+
 gp_test config_valid_watersheds(void)
 {
-    gp_test test;
+    gp_test test = {0};
     test.name = "Watershed isValid";
     test.description =
         "Test validity for each watershed polygon.";
     test.func_setup = setup;
     test.func_run = run;
     test.func_cleanup = cleanup;
-    test.count = 30;
+    test.func_thread_setup = thread_setup;
+    test.func_thread_run = thread_run;
+    test.func_thread_cleanup = thread_cleanup;
+    test.count_min = 30;
+    test.count_max = 300;
+    test.data_files = data_files;
     return test;
 }
 
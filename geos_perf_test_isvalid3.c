@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "geos_perf.h"
 
@@ -36,20 +37,61 @@ static void cleanup(void)
     geomlist_free(&land_covers);
 }
 
+/*************************************************************************
+* THREADED VERSION
+*/
+
+/* Each thread reads its own copy of the land covers */
+static void* thread_setup(GEOSContextHandle_t ctx)
+{
+    GEOSGeometryList* land_covers = malloc(sizeof(GEOSGeometryList));
+    geomlist_init(land_covers);
+    read_data_file_r(ctx, "invalid_land_cover.wkt.gz", land_covers);
+    return land_covers;
+}
+
+static void thread_run(GEOSContextHandle_t ctx, void* state)
+{
+    size_t i;
+    GEOSGeometryList* land_covers = (GEOSGeometryList*)state;
+    for (i = 0; i < geomlist_size(land_covers); i++)
+    {
+        const GEOSGeometry* g = geomlist_get(land_covers, i);
+        GEOSisValid_r(ctx, g);
+    }
+}
+
+static void thread_cleanup(GEOSContextHandle_t ctx, void* state)
+{
+    geomlist_free_r(ctx, (GEOSGeometryList*)state);
+    free(state);
+}
+
 /*************************************************************************
 * CONFIGURATION CALLBACK FUNCTION
 */
 
+/* Files the runner checks for before setup */
+static const char* const data_files[] = {
+    "invalid_land_cover.wkt.gz",
+    NULL
+};
+
 gp_test config_isvalid_landcover(void)
 {
-    gp_test test;
+    gp_test test = {0};
     test.name = "Landcover isValid";
     test.description =
         "Test validity for each landcover polygon.";
     test.func_setup = setup;
     test.func_run = run;
     test.func_cleanup = cleanup;
-    test.count = 20;
+    test.func_thread_setup = thread_setup;
+    test.func_thread_run = thread_run;
+    test.func_thread_cleanup = thread_cleanup;
+    test.count_min = 20;
+    test.count_max = 200;
+    test.data_files = data_files;
     return test;
 }
 
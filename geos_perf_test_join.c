@@ -0,0 +1,320 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "geos_perf.h"
+
+/*************************************************************************
+* PERFORMANCE TEST
+*
+* Point in polygon spatial join. Random points over the extent
+* of the watersheds are tagged with the watershed that contains
+* them: each point queries an STRtree of the watershed envelopes,
+* and each candidate is refined with a prepared contains test,
+* giving a list of (point, watershed) pairs. The partitioned
+* version splits the points into strips by x, one per thread.
+* The threads share the tree, which is built before they start,
+* but each prepares its own watersheds, since prepared geometries
+* build their indexes lazily and are not safe to share.
+*/
+
+#define JOIN_SEED 1
+
+typedef struct {
+    uint32_t point;
+    uint32_t polygon;
+} gp_join_pair;
+
+/* The pairs found by one thread, and its prepared watersheds */
+typedef struct {
+    GEOSContextHandle_t ctx;
+    const GEOSPreparedGeometry** prepared;
+    size_t begin;
+    size_t end;
+    gp_join_pair* pairs;
+    size_t npairs;
+    size_t capacity;
+    uint32_t point;
+} gp_join_part;
+
+/* Variables where data lives between the setup/run/cleanup stages */
+static const GEOSGeometryList* watersheds;
+static GEOSGeometryList points;
+static GEOSSTRtree* tree;
+static uint32_t* polygon_ids;
+static gp_join_part* parts;
+static size_t nparts;
+
+/* Sweep with -p points=10000,100000,1000000 */
+static gp_param params[] = {
+    {"points", "100000", NULL},
+    {"node_capacity", "10", NULL},
+    {NULL, NULL, NULL}
+};
+
+/* and with -p threads=1,2,4,8 for the partitioned join */
+static gp_param partitioned_params[] = {
+    {"points", "100000", NULL},
+    {"node_capacity", "10", NULL},
+    {"threads", "4", NULL},
+    {NULL, NULL, NULL}
+};
+
+static int
+cmp_x(const void* a, const void* b)
+{
+    double xa = *(const double*)a;
+    double xb = *(const double*)b;
+    return (xa > xb) - (xa < xb);
+}
+
+/*
+* Random points over the extent of the watersheds, sorted by x
+* so that each partition is a strip.
+*/
+static void
+points_create(size_t npoints)
+{
+    size_t i;
+    uint64_t rng = JOIN_SEED;
+    double xmin, ymin, xmax, ymax;
+    double* xy = malloc(sizeof(double) * 2 * npoints);
+
+    geomlist_extent(watersheds, &xmin, &ymin, &xmax, &ymax);
+    for (i = 0; i < npoints; i++)
+    {
+        xy[2 * i] = xmin + random_double(&rng) * (xmax - xmin);
+        xy[2 * i + 1] = ymin + random_double(&rng) * (ymax - ymin);
+    }
+    qsort(xy, npoints, sizeof(double) * 2, cmp_x);
+
+    geomlist_init(&points);
+    for (i = 0; i < npoints; i++)
+        geomlist_push(&points, createPointFromXY(xy[2 * i], xy[2 * i + 1]));
+    free(xy);
+}
+
+static void
+tree_callback(void* item, void* userdata)
+{
+    return;
+}
+
+/* Index the watershed envelopes, keyed by their position in the list */
+static void
+tree_create(size_t node_capacity)
+{
+    size_t i, n = geomlist_size(watersheds);
+    polygon_ids = malloc(sizeof(uint32_t) * (n + 1));
+    tree = GEOSSTRtree_create(node_capacity);
+    for (i = 0; i < n; i++)
+    {
+        polygon_ids[i] = (uint32_t)i;
+        GEOSSTRtree_insert(tree, geomlist_get(watersheds, i), polygon_ids + i);
+    }
+    /* The first query builds the tree, so do it before any thread shares it */
+    if (geomlist_size(&points) > 0)
+        GEOSSTRtree_query(tree, geomlist_get(&points, 0), tree_callback, NULL);
+}
+
+/* Each part gets its own context and prepared watersheds, and a strip of the points */
+static void
+parts_create(size_t n)
+{
+    size_t i, j, npoints = geomlist_size(&points);
+    size_t nwatersheds = geomlist_size(watersheds);
+    nparts = n < 1 ? 1 : n;
+    parts = calloc(nparts, sizeof(gp_join_part));
+    for (i = 0; i < nparts; i++)
+    {
+        gp_join_part* part = parts + i;
+        part->ctx = GEOS_init_r();
+        part->prepared = malloc(sizeof(GEOSPreparedGeometry*) * (nwatersheds + 1));
+        for (j = 0; j < nwatersheds; j++)
+            part->prepared[j] = GEOSPrepare_r(part->ctx, geomlist_get(watersheds, j));
+        part->begin = i * npoints / nparts;
+        part->end = (i + 1) * npoints / nparts;
+        part->capacity = 1024;
+        part->pairs = malloc(sizeof(gp_join_pair) * part->capacity);
+    }
+}
+
+static void
+parts_free(void)
+{
+    size_t i, j;
+    for (i = 0; i < nparts; i++)
+    {
+        gp_join_part* part = parts + i;
+        for (j = 0; j < geomlist_size(watersheds); j++)
+            GEOSPreparedGeom_destroy_r(part->ctx, part->prepared[j]);
+        free(part->prepared);
+        free(part->pairs);
+        GEOS_finish_r(part->ctx);
+    }
+    free(parts);
+    parts = NULL;
+    nparts = 0;
+}
+
+/* Refine a candidate with the prepared contains test */
+static void
+join_callback(void* item, void* userdata)
+{
+    gp_join_part* part = (gp_join_part*)userdata;
+    uint32_t polygon = *(uint32_t*)item;
+    const GEOSGeometry* pt = geomlist_get(&points, part->point);
+    if (!GEOSPreparedContains_r(part->ctx, part->prepared[polygon], pt))
+        return;
+    if (part->npairs == part->capacity)
+    {
+        part->capacity *= 2;
+        part->pairs = realloc(part->pairs, sizeof(gp_join_pair) * part->capacity);
+    }
+    part->pairs[part->npairs].point = part->point;
+    part->pairs[part->npairs].polygon = polygon;
+    part->npairs++;
+}
+
+static void*
+join_part(void* arg)
+{
+    gp_join_part* part = (gp_join_part*)arg;
+    size_t i;
+    part->npairs = 0;
+    for (i = part->begin; i < part->end; i++)
+    {
+        part->point = (uint32_t)i;
+        GEOSSTRtree_query_r(part->ctx, tree, geomlist_get(&points, i), join_callback, part);
+    }
+    return NULL;
+}
+
+static size_t
+join_pairs(void)
+{
+    size_t i, npairs = 0;
+    for (i = 0; i < nparts; i++)
+        npairs += parts[i].npairs;
+    return npairs;
+}
+
+/*
+* Load, generate and index, then join once untimed, to build the
+* lazy indexes of the prepared watersheds and count the pairs.
+*/
+static void
+join_setup(gp_param* p, size_t nthreads)
+{
+    size_t i, node_capacity = param_node_capacity(p);
+    if (!node_capacity)
+        return;
+    watersheds = dataset_acquire("watersheds.wkt.gz");
+    if (!watersheds)
+        return;
+    points_create((size_t)param_double(p, "points"));
+    tree_create(node_capacity);
+    parts_create(nthreads);
+    for (i = 0; i < nparts; i++)
+        join_part(parts + i);
+    work_report(join_pairs(), join_pairs() * sizeof(gp_join_pair));
+}
+
+static void
+setup(void)
+{
+    join_setup(params, 1);
+}
+
+static void
+run(void)
+{
+    join_part(parts);
+}
+
+static void
+partitioned_setup(void)
+{
+    join_setup(partitioned_params, (size_t)param_double(partitioned_params, "threads"));
+}
+
+/* One thread per strip, all started and joined inside the run */
+static void
+partitioned_run(void)
+{
+    size_t i;
+    pthread_t* threads = malloc(sizeof(pthread_t) * nparts);
+    char* started = malloc(nparts);
+    /* A strip whose thread can't start is joined on this thread */
+    for (i = 0; i < nparts; i++)
+    {
+        started[i] = pthread_create(threads + i, NULL, join_part, parts + i) == 0;
+        if (!started[i])
+            join_part(parts + i);
+    }
+    for (i = 0; i < nparts; i++)
+    {
+        if (started[i])
+            pthread_join(threads[i], NULL);
+    }
+    free(started);
+    free(threads);
+}
+
+/* Clean up any remaining memory */
+static void
+cleanup(void)
+{
+    parts_free();
+    GEOSSTRtree_destroy(tree);
+    free(polygon_ids);
+    geomlist_free(&points);
+    dataset_release(watersheds);
+}
+
+/*************************************************************************
+* CONFIGURATION CALLBACK FUNCTIONS
+*/
+
+/* Files the runner checks for before setup */
+static const char* const data_files[] = {
+    "watersheds.wkt.gz",
+    NULL
+};
+
+gp_test config_join(void)
+{
+    gp_test test = {0};
+    test.name = "Spatial join";
+    test.description =
+        "Tag random points with the watershed that contains "
+        "them, querying an STRtree of the watersheds and "
+        "refining with prepared contains.";
+    test.func_setup = setup;
+    test.func_run = run;
+    test.func_cleanup = cleanup;
+    test.params = params;
+    test.count_min = 5;
+    test.count_max = 50;
+    test.data_files = data_files;
+    return test;
+}
+
+gp_test config_join_partitioned(void)
+{
+    gp_test test = {0};
+    test.name = "Spatial join partitioned";
+    test.description =
+        "Tag random points with the watershed that contains "
+        "them, on one thread per strip of the points, sharing "
+        "the STRtree of the watersheds.";
+    test.func_setup = partitioned_setup;
+    test.func_run = partitioned_run;
+    test.func_cleanup = cleanup;
+    test.params = partitioned_params;
+    test.count_min = 5;
+    test.count_max = 50;
+    test.data_files = data_files;
+    return test;
+}
@@ -8,10 +8,18 @@
 */
 
 /* Variables where data lives between the setup/run/cleanup stages */
-static GEOSGeometryList watersheds;
+static const GEOSGeometryList* watersheds;
 static GEOSGeometryList prepared_watersheds;
 static GEOSSTRtree* tree;
 
+/* Parameters that can be swept with -p grid=..., the number of
+   probe points along the longer side of each watershed envelope */
+static gp_param params[] = {
+    {"grid", "25", NULL},
+    {NULL, NULL, NULL}
+};
+static double grid;
+
 
 /* Read any data we need, and create any structures */
 static void
@@ -21,8 +29,15 @@ setup(void)
     double xmin, xmax, ymin, ymax;
     xmin = ymin = FLT_MAX;
     xmax = ymax = -1 * FLT_MAX;
-    geomlist_init(&watersheds);
-    read_data_file("watersheds.wkt.gz", &watersheds);
+    grid = param_double(params, "grid");
+    if (!(grid > 0))
+    {
+        skip_report("grid must be positive, not %s", param_get(params, "grid"));
+        return;
+    }
+    watersheds = dataset_acquire("watersheds.wkt.gz");
+    if (!watersheds)
+        return;
 }
 
 
@@ -54,19 +69,19 @@ getGeometryBounds(const GEOSGeometry* g, double* xmin, double* ymin, double* xma
 static void
 run(void)
 {
-    for (size_t i = 0; i < geomlist_size(&watersheds); i++)
+    for (size_t i = 0; i < geomlist_size(watersheds); i++)
     {
         double xmin, ymin, xmax, ymax;
         double w, h, s, r, x, y;
 
-        const GEOSGeometry* geom = geomlist_get(&watersheds, i);
+        const GEOSGeometry* geom = geomlist_get(watersheds, i);
         const GEOSPreparedGeometry* prepgeom = GEOSPrepare(geom);
 
         getGeometryBounds(geom, &xmin, &ymin, &xmax, &ymax);
         w = xmax - xmin;
         h = ymax - ymin;
         s = w < h ? h : w;
-        r = s / 25;
+        r = s / grid;
         for (x = xmin; x < xmax; x += r)
         {
             for (y = ymin; y < ymax; y += r)
@@ -88,16 +103,22 @@ run(void)
 static void
 cleanup(void)
 {
-    geomlist_free(&watersheds);
+    dataset_release(watersheds);
 }
 
 /*************************************************************************
 * CONFIGURATION CALLBACK FUNCTION
 */
 
+/* Files the runner checks for before setup */
+static const char* const data_files[] = {
+    "watersheds.wkt.gz",
+    NULL
+};
+
 gp_test config_point_in_polygon(void)
 {
-    gp_test test;
+    gp_test test = {0};
     test.name = "Prepared geometry";
     test.description =
         "Load the watersheds, and for each watershed compare"
@@ -107,7 +128,10 @@ gp_test config_point_in_polygon(void)
     test.func_setup = setup;
     test.func_run = run;
     test.func_cleanup = cleanup;
-    test.count = 50;
+    test.params = params;
+    test.count_min = 50;
+    test.count_max = 500;
+    test.data_files = data_files;
     return test;
 }
 
@@ -0,0 +1,333 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "geos_perf.h"
+
+/*************************************************************************
+* PERFORMANCE TEST
+*
+* Prepared geometry, with preparation and querying timed apart.
+* "Prepared geometry" prepares every watershed on every run and
+* mixes that with its probes. Here "Prepare" times preparing the
+* watersheds on its own, including the lazy indexes that the
+* first query builds, and "Prepared query" times random probe
+* points against a sample of watersheds that stay prepared
+* across runs, the way a long-lived cache holds them. Its
+* prepare parameter switches to preparing each polygon in the
+* run (no reuse) or not preparing at all, and sweeping probes
+* shows how many queries it takes for preparation to pay off.
+*/
+
+/* Distinct probe points kept per polygon, larger counts cycle through them */
+#define PROBE_POOL 16384
+#define PROBE_SEED 1
+
+typedef char (*gp_prepared_pred)(const GEOSPreparedGeometry* pg, const GEOSGeometry* g);
+typedef char (*gp_pred)(const GEOSGeometry* g1, const GEOSGeometry* g2);
+typedef char (*gp_prepared_pred_xy)(const GEOSPreparedGeometry* pg, double x, double y);
+
+typedef struct {
+    const char* name;
+    gp_prepared_pred prepared;
+    gp_pred plain;
+    gp_prepared_pred_xy prepared_xy;
+} gp_predicate;
+
+enum {
+    PREPARE_CACHED,
+    PREPARE_EACH,
+    PREPARE_NONE
+};
+
+/* Variables where data lives between the setup/run/cleanup stages */
+static const GEOSGeometryList* watersheds;
+static const gp_predicate* predicate;
+static int prepare;
+static size_t npolygons;
+static size_t nprobes;
+static size_t npool;
+static const GEOSGeometry** polygons;
+static const GEOSPreparedGeometry** prepared;
+static GEOSGeometry** probes;
+static double* probe_xy;
+
+/* Sweep with -p probes=100,1000,10000,100000,1000000 */
+static gp_param params[] = {
+    {"predicate", "contains", NULL},
+    {"prepare", "cached", NULL},
+    {"probes", "1000", NULL},
+    {"polygons", "16", NULL},
+    {NULL, NULL, NULL}
+};
+
+static gp_param prepare_params[] = {
+    {"predicate", "contains", NULL},
+    {NULL, NULL, NULL}
+};
+
+/* ContainsProperly has no plain predicate of its own */
+static char
+contains_properly(const GEOSGeometry* g1, const GEOSGeometry* g2)
+{
+    return GEOSRelatePattern(g1, g2, "T**FF*FF*");
+}
+
+static const gp_predicate predicates[] = {
+    {"contains", GEOSPreparedContains, GEOSContains, NULL},
+    {"intersects", GEOSPreparedIntersects, GEOSIntersects, NULL},
+    {"covers", GEOSPreparedCovers, GEOSCovers, NULL},
+    {"containsproperly", GEOSPreparedContainsProperly, contains_properly, NULL},
+#if GEOS_VERSION_CMP >= 312
+    {"containsxy", GEOSPreparedContains, GEOSContains, GEOSPreparedContainsXY},
+    {"intersectsxy", GEOSPreparedIntersects, GEOSIntersects, GEOSPreparedIntersectsXY},
+#endif
+    {NULL, NULL, NULL, NULL}
+};
+
+/* Predicate by name, skipping the test when it is unknown or unavailable */
+static const gp_predicate*
+predicate_find(const char* name)
+{
+    const gp_predicate* pred;
+    for (pred = predicates; pred->name; pred++)
+    {
+        if (strcmp(pred->name, name) == 0)
+            return pred;
+    }
+    skip_report("predicate '%s' is unknown or unavailable", name);
+    return NULL;
+}
+
+/* Prepare mode by name, skipping the test when it is unknown */
+static int
+prepare_mode(const char* name)
+{
+    if (strcmp(name, "cached") == 0)
+        return PREPARE_CACHED;
+    if (strcmp(name, "each") == 0)
+        return PREPARE_EACH;
+    if (strcmp(name, "none") == 0)
+        return PREPARE_NONE;
+    skip_report("prepare mode '%s' is unknown", name);
+    return -1;
+}
+
+/* One query, through the XY call when the predicate has one */
+static char
+query_prepared(const GEOSPreparedGeometry* pg, size_t probe)
+{
+    if (predicate->prepared_xy)
+        return predicate->prepared_xy(pg, probe_xy[2 * probe], probe_xy[2 * probe + 1]);
+    return predicate->prepared(pg, probes[probe]);
+}
+
+/* Random probe points in the envelope of each sampled polygon */
+static void
+probes_create(void)
+{
+    size_t i, j;
+    uint64_t rng = PROBE_SEED;
+    GEOSContextHandle_t ctx = GEOS_init_r();
+    npool = nprobes < PROBE_POOL ? nprobes : PROBE_POOL;
+    probes = malloc(sizeof(GEOSGeometry*) * npolygons * npool);
+    probe_xy = malloc(sizeof(double) * 2 * npolygons * npool);
+    for (i = 0; i < npolygons; i++)
+    {
+        double xmin = 0, ymin = 0, xmax = 0, ymax = 0;
+        geom_extent_r(ctx, polygons[i], &xmin, &ymin, &xmax, &ymax);
+        for (j = 0; j < npool; j++)
+        {
+            size_t k = i * npool + j;
+            probe_xy[2 * k] = xmin + random_double(&rng) * (xmax - xmin);
+            probe_xy[2 * k + 1] = ymin + random_double(&rng) * (ymax - ymin);
+            probes[k] = createPointFromXY(probe_xy[2 * k], probe_xy[2 * k + 1]);
+        }
+    }
+    GEOS_finish_r(ctx);
+}
+
+/* Prepare a polygon, and run one query to build its lazy indexes */
+static const GEOSPreparedGeometry*
+prepare_polygon(const GEOSGeometry* g, size_t probe)
+{
+    const GEOSPreparedGeometry* pg = GEOSPrepare(g);
+    query_prepared(pg, probe);
+    return pg;
+}
+
+/*************************************************************************
+* Prepare
+*/
+
+static void
+prepare_setup(void)
+{
+    size_t i;
+    predicate = predicate_find(param_get(prepare_params, "predicate"));
+    if (!predicate)
+        return;
+    watersheds = dataset_acquire("watersheds.wkt.gz");
+    if (!watersheds)
+        return;
+    npolygons = geomlist_size(watersheds);
+    polygons = malloc(sizeof(GEOSGeometry*) * (npolygons + 1));
+    for (i = 0; i < npolygons; i++)
+        polygons[i] = geomlist_get(watersheds, i);
+    nprobes = 1;
+    probes_create();
+    work_report(npolygons, 0);
+}
+
+/* Prepare every watershed, build its indexes and throw it away */
+static void
+prepare_run(void)
+{
+    size_t i;
+    for (i = 0; i < npolygons; i++)
+        GEOSPreparedGeom_destroy(prepare_polygon(polygons[i], i));
+}
+
+static void
+probes_free(void)
+{
+    size_t i;
+    for (i = 0; i < npolygons * npool; i++)
+        GEOSGeom_destroy(probes[i]);
+    free(probes);
+    free(probe_xy);
+    free(polygons);
+    probes = NULL;
+    probe_xy = NULL;
+    polygons = NULL;
+}
+
+static void
+prepare_cleanup(void)
+{
+    probes_free();
+    dataset_release(watersheds);
+}
+
+/*************************************************************************
+* Prepared query
+*/
+
+static void
+query_setup(void)
+{
+    size_t i, n;
+    predicate = predicate_find(param_get(params, "predicate"));
+    prepare = prepare_mode(param_get(params, "prepare"));
+    if (!predicate || prepare < 0)
+        return;
+    watersheds = dataset_acquire("watersheds.wkt.gz");
+    if (!watersheds)
+        return;
+    nprobes = (size_t)param_double(params, "probes");
+    npolygons = (size_t)param_double(params, "polygons");
+    n = geomlist_size(watersheds);
+    if (nprobes < 1)
+        nprobes = 1;
+    if (npolygons < 1 || npolygons > n)
+        npolygons = n;
+
+    /* Spread the sample over the whole file */
+    polygons = malloc(sizeof(GEOSGeometry*) * npolygons);
+    for (i = 0; i < npolygons; i++)
+        polygons[i] = geomlist_get(watersheds, i * n / npolygons);
+    probes_create();
+
+    prepared = calloc(npolygons, sizeof(GEOSPreparedGeometry*));
+    if (prepare == PREPARE_CACHED)
+    {
+        for (i = 0; i < npolygons; i++)
+            prepared[i] = prepare_polygon(polygons[i], i * npool);
+    }
+    work_report(npolygons * nprobes, 0);
+}
+
+/* Probe every sampled polygon */
+static void
+query_run(void)
+{
+    size_t i, j;
+    for (i = 0; i < npolygons; i++)
+    {
+        const GEOSGeometry* g = polygons[i];
+        size_t base = i * npool;
+        if (prepare == PREPARE_NONE)
+        {
+            for (j = 0; j < nprobes; j++)
+                predicate->plain(g, probes[base + j % npool]);
+        }
+        else
+        {
+            const GEOSPreparedGeometry* pg = prepare == PREPARE_EACH ? GEOSPrepare(g) : prepared[i];
+            for (j = 0; j < nprobes; j++)
+                query_prepared(pg, base + j % npool);
+            if (prepare == PREPARE_EACH)
+                GEOSPreparedGeom_destroy(pg);
+        }
+    }
+}
+
+static void
+query_cleanup(void)
+{
+    size_t i;
+    for (i = 0; i < npolygons; i++)
+    {
+        if (prepared[i])
+            GEOSPreparedGeom_destroy(prepared[i]);
+    }
+    free(prepared);
+    prepared = NULL;
+    probes_free();
+    dataset_release(watersheds);
+}
+
+/*************************************************************************
+* CONFIGURATION CALLBACK FUNCTIONS
+*/
+
+/* Files the runner checks for before setup */
+static const char* const data_files[] = {
+    "watersheds.wkt.gz",
+    NULL
+};
+
+gp_test config_prepare(void)
+{
+    gp_test test = {0};
+    test.name = "Prepare";
+    test.description =
+        "Prepare every watershed and run one query of the "
+        "predicate, which builds the indexes it uses.";
+    test.func_setup = prepare_setup;
+    test.func_run = prepare_run;
+    test.func_cleanup = prepare_cleanup;
+    test.params = prepare_params;
+    test.count_min = 10;
+    test.count_max = 100;
+    test.data_files = data_files;
+    return test;
+}
+
+gp_test config_prepared_query(void)
+{
+    gp_test test = {0};
+    test.name = "Prepared query";
+    test.description =
+        "Query a sample of watersheds with random points from "
+        "their envelopes, preparing them once, on every run or "
+        "not at all.";
+    test.func_setup = query_setup;
+    test.func_run = query_run;
+    test.func_cleanup = query_cleanup;
+    test.params = params;
+    test.count_min = 5;
+    test.count_max = 50;
+    test.data_files = data_files;
+    return test;
+}
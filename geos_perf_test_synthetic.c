@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "geos_perf.h"
+
+/*************************************************************************
+* PERFORMANCE TEST
+*/
+
+/* Variables where data lives between the setup/run/cleanup stages */
+static const GEOSGeometryList* geoms;
+
+/* Parameters that pick the generated dataset, sweep them with */
+/* -p size=1000,10000,100000,1000000 to see how validation scales */
+static gp_param params[] = {
+    {"kind", "polygon", NULL},
+    {"size", "10000", NULL},
+    {"vertices", "32", NULL},
+    {NULL, NULL, NULL}
+};
+
+static void
+dataset_name(char* name, size_t len)
+{
+    snprintf(name, len, "synthetic:%s:%s:%s",
+        param_get(params, "kind"),
+        param_get(params, "size"),
+        param_get(params, "vertices"));
+}
+
+/* Generate the dataset, or share it if an earlier test made the same one */
+static void setup(void)
+{
+    char name[MAXSTRLEN];
+    const char* kind = param_get(params, "kind");
+    if (!synthetic_kind_known(kind))
+    {
+        skip_report("unknown synthetic kind '%s'", kind);
+        return;
+    }
+    dataset_name(name, MAXSTRLEN);
+    geoms = dataset_acquire(name);
+}
+
+/* For each run, valid test each geometry in the dataset */
+static void run(void)
+{
+    size_t i;
+    for (i = 0; i < geomlist_size(geoms); i++)
+    {
+        const GEOSGeometry* g = geomlist_get(geoms, i);
+        GEOSisValid(g);
+    }
+}
+
+/* Clean up any remaining memory */
+static void cleanup(void)
+{
+    dataset_release(geoms);
+}
+
+/*************************************************************************
+* THREADED VERSION
+*/
+
+/* Each thread generates its own copy of the dataset */
+static void* thread_setup(GEOSContextHandle_t ctx)
+{
+    char name[MAXSTRLEN];
+    GEOSGeometryList* geoms;
+    const char* kind = param_get(params, "kind");
+    if (!synthetic_kind_known(kind))
+    {
+        skip_report("unknown synthetic kind '%s'", kind);
+        return NULL;
+    }
+    geoms = malloc(sizeof(GEOSGeometryList));
+    dataset_name(name, MAXSTRLEN);
+    geomlist_init(geoms);
+    read_data_file_r(ctx, name, geoms);
+    return geoms;
+}
+
+static void thread_run(GEOSContextHandle_t ctx, void* state)
+{
+    size_t i;
+    GEOSGeometryList* geoms = (GEOSGeometryList*)state;
+    for (i = 0; i < geomlist_size(geoms); i++)
+    {
+        const GEOSGeometry* g = geomlist_get(geoms, i);
+        GEOSisValid_r(ctx, g);
+    }
+}
+
+static void thread_cleanup(GEOSContextHandle_t ctx, void* state)
+{
+    geomlist_free_r(ctx, (GEOSGeometryList*)state);
+    free(state);
+}
+
+/*************************************************************************
+* CONFIGURATION CALLBACK FUNCTION
+*/
+
+gp_test config_synthetic_isvalid(void)
+{
+    gp_test test = {0};
+    test.name = "Synthetic isValid";
+    test.description =
+        "Generate a synthetic dataset of a given kind and size "
+        "and run the validity test on every feature. Exercises "
+        "isValid on inputs of any size, including polygons "
+        "with holes and self-touching rings.";
+    test.func_setup = setup;
+    test.func_run = run;
+    test.func_cleanup = cleanup;
+    test.func_thread_setup = thread_setup;
+    test.func_thread_run = thread_run;
+    test.func_thread_cleanup = thread_cleanup;
+    test.params = params;
+    test.count_min = 5;
+    test.count_max = 50;
+    return test;
+}
@@ -0,0 +1,297 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <math.h>
+
+#include "geos_perf.h"
+
+/*************************************************************************
+* PERFORMANCE TEST
+*
+* STRtree construction, apart from querying. The other tree tests
+* build their trees in setup, or leave the build to the first
+* query. "STRtree build" makes a new tree of a synthetic dataset
+* on every run, timing the inserts, the build and the destroy
+* separately, and measures the heap the tree holds per item.
+* "STRtree query" times window queries on a tree built in setup.
+* GEOSSTRtree_build is in GEOS 3.12, and with older versions the
+* build is forced with one query.
+*/
+
+/* Items the query windows are sized to hit, on average */
+#define QUERY_HITS 10
+#define QUERY_SEED 1
+
+/* Variables where data lives between the setup/run/cleanup stages */
+static const GEOSGeometryList* items;
+static GEOSSTRtree* tree;
+static GEOSGeometryList windows;
+static size_t node_capacity;
+static size_t hits;
+
+/* Per-run phase times, summarized in cleanup */
+static double* insert_times;
+static double* build_times;
+static double* destroy_times;
+static size_t ntimes;
+static size_t times_capacity;
+
+/*
+* Sweep with -p size=1000,10000,100000,1000000,10000000
+* and -p node_capacity=4,8,10,16,32,64, on -p kind=uniform,polygon
+*/
+static gp_param params[] = {
+    {"kind", "uniform", NULL},
+    {"size", "100000", NULL},
+    {"node_capacity", "10", NULL},
+    {NULL, NULL, NULL}
+};
+
+static gp_param query_params[] = {
+    {"kind", "uniform", NULL},
+    {"size", "100000", NULL},
+    {"node_capacity", "10", NULL},
+    {"queries", "10000", NULL},
+    {NULL, NULL, NULL}
+};
+
+/*
+* The synthetic dataset the tree is built from, or NULL with the
+* test skipped when the kind or size is bad, or the dataset empty.
+*/
+static const GEOSGeometryList*
+items_acquire(gp_param* p)
+{
+    char name[MAXSTRLEN];
+    char* end;
+    const GEOSGeometryList* geoms;
+    const char* kind = param_get(p, "kind");
+    const char* size = param_get(p, "size");
+    if (!synthetic_kind_known(kind))
+    {
+        skip_report("unknown synthetic kind '%s'", kind);
+        return NULL;
+    }
+    /* The dataset name is parsed with %llu, which reads 1e6 as 1 */
+    if (!isdigit((unsigned char)size[0]) || strtoull(size, &end, 10) == 0 || *end)
+    {
+        skip_report("size must be a positive integer, not %s", size);
+        return NULL;
+    }
+    snprintf(name, MAXSTRLEN, "synthetic:%s:%s", kind, size);
+    geoms = dataset_acquire(name);
+    if (!geoms)
+        return NULL;
+    if (geomlist_size(geoms) == 0)
+    {
+        dataset_release(geoms);
+        skip_report("synthetic dataset %s is empty", name);
+        return NULL;
+    }
+    return geoms;
+}
+
+static void
+tree_callback(void* item, void* userdata)
+{
+    hits++;
+}
+
+static void
+tree_insert(void)
+{
+    size_t i;
+    tree = GEOSSTRtree_create(node_capacity);
+    for (i = 0; i < geomlist_size(items); i++)
+    {
+        const GEOSGeometry* geom = geomlist_get(items, i);
+        GEOSSTRtree_insert(tree, geom, (void*)geom);
+    }
+}
+
+static void
+tree_build(void)
+{
+#if GEOS_VERSION_CMP >= 312
+    GEOSSTRtree_build(tree);
+#else
+    if (geomlist_size(items) > 0)
+        GEOSSTRtree_query(tree, geomlist_get(items, 0), tree_callback, NULL);
+#endif
+}
+
+/*************************************************************************
+* STRtree build
+*/
+
+static void
+build_setup(void)
+{
+    int64_t heap;
+    node_capacity = param_node_capacity(params);
+    if (!node_capacity)
+        return;
+    items = items_acquire(params);
+    if (!items)
+        return;
+    ntimes = 0;
+
+    /* One tree untimed, to see how much heap it holds */
+    heap = heap_in_use();
+    tree_insert();
+    tree_build();
+    heap = heap_in_use() - heap;
+    GEOSSTRtree_destroy(tree);
+    tree = NULL;
+    if (heap > 0 && geomlist_size(items) > 0)
+        note_report("%0.1f bytes of tree per item",
+            (double)heap / geomlist_size(items));
+    work_report(geomlist_size(items), 0);
+}
+
+/* Make, build and destroy a tree, timing each step of the timed runs */
+static void
+build_run(void)
+{
+    double t0, t1, t2, t3;
+    t0 = seconds_now();
+    tree_insert();
+    t1 = seconds_now();
+    tree_build();
+    t2 = seconds_now();
+    GEOSSTRtree_destroy(tree);
+    t3 = seconds_now();
+    tree = NULL;
+    if (warmup_running())
+        return;
+    if (ntimes == times_capacity)
+    {
+        times_capacity = times_capacity ? 2 * times_capacity : 64;
+        insert_times = realloc(insert_times, sizeof(double) * times_capacity);
+        build_times = realloc(build_times, sizeof(double) * times_capacity);
+        destroy_times = realloc(destroy_times, sizeof(double) * times_capacity);
+    }
+    insert_times[ntimes] = t1 - t0;
+    build_times[ntimes] = t2 - t1;
+    destroy_times[ntimes] = t3 - t2;
+    ntimes++;
+}
+
+static void
+build_cleanup(void)
+{
+    gp_stats insert, build, destroy;
+    if (ntimes > 0)
+    {
+        stats_compute(insert_times, ntimes, &insert);
+        stats_compute(build_times, ntimes, &build);
+        stats_compute(destroy_times, ntimes, &destroy);
+        note_report("median of %zu runs: insert %0.3gs, build %0.3gs, destroy %0.3gs",
+            ntimes, insert.p50, build.p50, destroy.p50);
+    }
+    free(insert_times);
+    free(build_times);
+    free(destroy_times);
+    insert_times = build_times = destroy_times = NULL;
+    ntimes = times_capacity = 0;
+    dataset_release(items);
+}
+
+/*************************************************************************
+* STRtree query
+*/
+
+/*
+* Square windows at random spots of the dataset extent, sized so
+* that each covers the area of about QUERY_HITS items.
+*/
+static void
+windows_create(size_t nqueries)
+{
+    size_t i, n = geomlist_size(items);
+    uint64_t rng = QUERY_SEED;
+    double xmin, ymin, xmax, ymax, half;
+    geomlist_extent(items, &xmin, &ymin, &xmax, &ymax);
+    half = n > 0 ? 0.5 * sqrt((xmax - xmin) * (ymax - ymin) * QUERY_HITS / n) : 0.0;
+
+    geomlist_init(&windows);
+    for (i = 0; i < nqueries; i++)
+    {
+        double x = xmin + random_double(&rng) * (xmax - xmin);
+        double y = ymin + random_double(&rng) * (ymax - ymin);
+        geomlist_push(&windows, createRectangle(x - half, y - half, x + half, y + half));
+    }
+}
+
+static void
+query_setup(void)
+{
+    node_capacity = param_node_capacity(query_params);
+    if (!node_capacity)
+        return;
+    items = items_acquire(query_params);
+    if (!items)
+        return;
+    windows_create((size_t)param_double(query_params, "queries"));
+    tree_insert();
+    tree_build();
+    work_report(geomlist_size(&windows), 0);
+}
+
+/* Query the tree with every window, counting the hits */
+static void
+query_run(void)
+{
+    size_t i;
+    hits = 0;
+    for (i = 0; i < geomlist_size(&windows); i++)
+        GEOSSTRtree_query(tree, geomlist_get(&windows, i), tree_callback, NULL);
+}
+
+static void
+query_cleanup(void)
+{
+    if (geomlist_size(&windows) > 0)
+        note_report("%0.1f hits per query",
+            (double)hits / geomlist_size(&windows));
+    GEOSSTRtree_destroy(tree);
+    tree = NULL;
+    geomlist_free(&windows);
+    dataset_release(items);
+}
+
+/*************************************************************************
+* CONFIGURATION CALLBACK FUNCTIONS
+*/
+
+gp_test config_tree_build(void)
+{
+    gp_test test = {0};
+    test.name = "STRtree build";
+    test.description =
+        "Insert every item of a synthetic dataset into a new "
+        "STRtree, build it and destroy it, timing each step.";
+    test.func_setup = build_setup;
+    test.func_run = build_run;
+    test.func_cleanup = build_cleanup;
+    test.params = params;
+    test.count_min = 5;
+    test.count_max = 50;
+    return test;
+}
+
+gp_test config_tree_query(void)
+{
+    gp_test test = {0};
+    test.name = "STRtree query";
+    test.description =
+        "Query an STRtree of a synthetic dataset with random "
+        "windows that each cover about ten items.";
+    test.func_setup = query_setup;
+    test.func_run = query_run;
+    test.func_cleanup = query_cleanup;
+    test.params = query_params;
+    test.count_min = 10;
+    test.count_max = 100;
+    return test;
+}
@@ -0,0 +1,422 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "geos_perf.h"
+
+/*************************************************************************
+* PERFORMANCE TEST
+*
+* A point index that changes while it serves queries. The GEOS
+* STRtree is packed once, on its first query, and can't take
+* inserts after that, so this test keeps a lazily rebuilt index:
+* new points wait in a pending list that queries scan linearly,
+* and when the list reaches the pending limit the tree is rebuilt
+* from every live point. Removes go to the tree (or the pending
+* list). Each run does a random mix of inserts, removes, window
+* queries and nearest neighbour queries, timing every operation,
+* and the latencies per operation and the rebuilds are reported
+* in cleanup. A pending limit of 1 rebuilds on every insert.
+*/
+
+/* GEOS <= 3.5 lacks GEOSSTRtree_nearest() */
+#if GEOS_VERSION_CMP > 305
+
+#define CHURN_SEED 1
+#define CHURN_HITS 10
+
+enum {
+    OP_INSERT,
+    OP_REMOVE,
+    OP_QUERY,
+    OP_NEAREST,
+    OP_COUNT
+};
+
+static const char* op_names[OP_COUNT] = {
+    "insert", "remove", "query", "nearest"
+};
+
+/* Where an item is: not indexed, pending or in the tree */
+enum {
+    ITEM_ABSENT,
+    ITEM_PENDING,
+    ITEM_TREE
+};
+
+/* Variables where data lives between the setup/run/cleanup stages */
+static const GEOSGeometryList* points;
+static GEOSSTRtree* tree;
+static size_t node_capacity;
+static size_t npoints;
+static double* xy;
+static char* state;
+static size_t* live;       /* items pending or in the tree */
+static size_t* live_pos;   /* position of each item in live or absent */
+static size_t nlive;
+static size_t* absent;
+static size_t nabsent;
+static size_t* pending;
+static size_t* pending_pos;
+static size_t npending;
+static size_t max_pending;
+static double half;
+static uint64_t rng;
+static unsigned int weights[OP_COUNT];
+static unsigned int total_weight;
+static size_t nops;
+static size_t hits;
+
+/* Per-operation latencies of the timed runs, and their rebuilds */
+static double* latencies[OP_COUNT];
+static size_t nlatencies[OP_COUNT];
+static size_t latencies_capacity[OP_COUNT];
+static size_t rebuilds;
+static double rebuild_time;
+
+/* Sweep with -p pending=1,16,256,4096 to compare rebuild strategies */
+static gp_param params[] = {
+    {"data", "points_random_10000.wkt.gz", NULL},
+    {"ops", "10000", NULL},
+    {"insert", "20", NULL},
+    {"remove", "20", NULL},
+    {"query", "50", NULL},
+    {"nearest", "10", NULL},
+    {"pending", "256", NULL},
+    {"node_capacity", "10", NULL},
+    {NULL, NULL, NULL}
+};
+
+static void
+tree_callback(void* item, void* userdata)
+{
+    hits++;
+}
+
+/* Move an item between the live and absent lists */
+static void
+list_remove(size_t* list, size_t* n, size_t item)
+{
+    size_t pos = live_pos[item];
+    size_t last = list[--(*n)];
+    list[pos] = last;
+    live_pos[last] = pos;
+}
+
+static void
+list_add(size_t* list, size_t* n, size_t item)
+{
+    live_pos[item] = *n;
+    list[(*n)++] = item;
+}
+
+/* Pack a new tree of every live item */
+static void
+tree_rebuild(void)
+{
+    size_t i;
+    double start = seconds_now();
+    if (tree)
+        GEOSSTRtree_destroy(tree);
+    tree = GEOSSTRtree_create(node_capacity);
+    for (i = 0; i < nlive; i++)
+    {
+        size_t item = live[i];
+        state[item] = ITEM_TREE;
+        GEOSSTRtree_insert(tree, geomlist_get(points, item), (void*)geomlist_get(points, item));
+    }
+#if GEOS_VERSION_CMP >= 312
+    GEOSSTRtree_build(tree);
+#else
+    if (nlive > 0)
+        GEOSSTRtree_query(tree, geomlist_get(points, live[0]), tree_callback, NULL);
+#endif
+    npending = 0;
+    if (warmup_running())
+        return;
+    rebuilds++;
+    rebuild_time += seconds_now() - start;
+}
+
+/*************************************************************************
+* Operations
+*/
+
+static size_t
+random_item(const size_t* list, size_t n)
+{
+    return list[random_next(&rng) % n];
+}
+
+/* Index an absent item, rebuilding when the pending list is full */
+static void
+op_insert(void)
+{
+    size_t item;
+    if (nabsent == 0)
+        return;
+    item = random_item(absent, nabsent);
+    list_remove(absent, &nabsent, item);
+    list_add(live, &nlive, item);
+    state[item] = ITEM_PENDING;
+    pending_pos[item] = npending;
+    pending[npending++] = item;
+    if (npending >= max_pending)
+        tree_rebuild();
+}
+
+static void
+op_remove(void)
+{
+    size_t item;
+    const GEOSGeometry* g;
+    if (nlive == 0)
+        return;
+    item = random_item(live, nlive);
+    g = geomlist_get(points, item);
+    if (state[item] == ITEM_PENDING)
+    {
+        size_t last = pending[--npending];
+        pending[pending_pos[item]] = last;
+        pending_pos[last] = pending_pos[item];
+    }
+    else
+    {
+        GEOSSTRtree_remove(tree, g, (void*)g);
+    }
+    state[item] = ITEM_ABSENT;
+    list_remove(live, &nlive, item);
+    list_add(absent, &nabsent, item);
+}
+
+/* Query a window around a random point, in the tree and the pending list */
+static void
+op_query(GEOSGeometry* window, double x, double y)
+{
+    size_t i;
+    GEOSSTRtree_query(tree, window, tree_callback, NULL);
+    for (i = 0; i < npending; i++)
+    {
+        size_t item = pending[i];
+        if (fabs(xy[2 * item] - x) <= half && fabs(xy[2 * item + 1] - y) <= half)
+            hits++;
+    }
+}
+
+/* Nearest point in the tree, then any closer pending one */
+static void
+op_nearest(const GEOSGeometry* pt, double x, double y)
+{
+    size_t i;
+    double d2 = INFINITY;
+    const GEOSGeometry* nearest = nlive > npending ? GEOSSTRtree_nearest(tree, pt) : NULL;
+    if (nearest)
+    {
+        double nx, ny;
+        GEOSGeomGetX(nearest, &nx);
+        GEOSGeomGetY(nearest, &ny);
+        d2 = (nx - x) * (nx - x) + (ny - y) * (ny - y);
+    }
+    for (i = 0; i < npending; i++)
+    {
+        size_t item = pending[i];
+        double dx = xy[2 * item] - x;
+        double dy = xy[2 * item + 1] - y;
+        if (dx * dx + dy * dy < d2)
+        {
+            d2 = dx * dx + dy * dy;
+            nearest = geomlist_get(points, item);
+        }
+    }
+    if (nearest)
+        hits++;
+}
+
+static void
+latency_add(int op, double latency)
+{
+    if (warmup_running())
+        return;
+    if (nlatencies[op] == latencies_capacity[op])
+    {
+        latencies_capacity[op] = latencies_capacity[op] ? 2 * latencies_capacity[op] : 1024;
+        latencies[op] = realloc(latencies[op], sizeof(double) * latencies_capacity[op]);
+    }
+    latencies[op][nlatencies[op]++] = latency;
+}
+
+/*************************************************************************
+* Test stages
+*/
+
+/* Read the points and index 90% of them, leaving the rest to insert */
+static void
+setup(void)
+{
+    size_t i;
+    double xmin = 0, ymin = 0, xmax = 0, ymax = 0;
+    int op;
+
+    node_capacity = param_node_capacity(params);
+    if (!node_capacity)
+        return;
+    total_weight = 0;
+    for (op = 0; op < OP_COUNT; op++)
+    {
+        double w = param_double(params, op_names[op]);
+        weights[op] = w > 0 ? (unsigned int)w : 0;
+        total_weight += weights[op];
+        nlatencies[op] = 0;
+    }
+    if (total_weight == 0)
+    {
+        skip_report("every operation has a weight of 0");
+        return;
+    }
+    points = dataset_acquire(param_get(params, "data"));
+    if (!points)
+        return;
+    npoints = geomlist_size(points);
+    nops = (size_t)param_double(params, "ops");
+    max_pending = (size_t)param_double(params, "pending");
+    if (max_pending < 1)
+        max_pending = 1;
+
+    xy = malloc(sizeof(double) * 2 * (npoints + 1));
+    state = calloc(npoints + 1, 1);
+    live = malloc(sizeof(size_t) * (npoints + 1));
+    live_pos = malloc(sizeof(size_t) * (npoints + 1));
+    absent = malloc(sizeof(size_t) * (npoints + 1));
+    pending = malloc(sizeof(size_t) * (npoints + 1));
+    pending_pos = malloc(sizeof(size_t) * (npoints + 1));
+    nlive = nabsent = npending = 0;
+    for (i = 0; i < npoints; i++)
+    {
+        GEOSGeomGetX(geomlist_get(points, i), xy + 2 * i);
+        GEOSGeomGetY(geomlist_get(points, i), xy + 2 * i + 1);
+        if (i == 0 || xy[2 * i] < xmin) xmin = xy[2 * i];
+        if (i == 0 || xy[2 * i] > xmax) xmax = xy[2 * i];
+        if (i == 0 || xy[2 * i + 1] < ymin) ymin = xy[2 * i + 1];
+        if (i == 0 || xy[2 * i + 1] > ymax) ymax = xy[2 * i + 1];
+        if (i % 10 == 9)
+            list_add(absent, &nabsent, i);
+        else
+            list_add(live, &nlive, i);
+    }
+    half = npoints > 0 ? 0.5 * sqrt((xmax - xmin) * (ymax - ymin) * CHURN_HITS / npoints) : 0.0;
+
+    rng = CHURN_SEED;
+    tree = NULL;
+    tree_rebuild();
+    rebuilds = 0;
+    rebuild_time = 0.0;
+    work_report(nops, 0);
+}
+
+/* Run the mix of operations, timing each */
+static void
+run(void)
+{
+    size_t i;
+    hits = 0;
+    for (i = 0; i < nops; i++)
+    {
+        unsigned int r = (unsigned int)(random_next(&rng) % total_weight);
+        double x = 0, y = 0, start;
+        GEOSGeometry* probe = NULL;
+        int op = 0;
+        while (r >= weights[op])
+            r -= weights[op++];
+
+        /* Probes are made outside the timed operation */
+        if ((op == OP_QUERY || op == OP_NEAREST) && npoints > 0)
+        {
+            size_t item = random_next(&rng) % npoints;
+            x = xy[2 * item];
+            y = xy[2 * item + 1];
+            probe = op == OP_QUERY ?
+                createRectangle(x - half, y - half, x + half, y + half) :
+                createPointFromXY(x, y);
+        }
+
+        start = seconds_now();
+        switch (op)
+        {
+            case OP_INSERT:
+                op_insert();
+                break;
+            case OP_REMOVE:
+                op_remove();
+                break;
+            case OP_QUERY:
+                op_query(probe, x, y);
+                break;
+            case OP_NEAREST:
+                op_nearest(probe, x, y);
+                break;
+        }
+        latency_add(op, seconds_now() - start);
+        if (probe)
+            GEOSGeom_destroy(probe);
+    }
+}
+
+/* Report the latencies and rebuilds, and clean up any remaining memory */
+static void
+cleanup(void)
+{
+    int op;
+    for (op = 0; op < OP_COUNT; op++)
+    {
+        gp_stats stats;
+        if (nlatencies[op] == 0)
+            continue;
+        stats_compute(latencies[op], nlatencies[op], &stats);
+        note_report("%s: %zu ops, latency p50 %0.3gus, p99 %0.3gus, max %0.3gus",
+            op_names[op], nlatencies[op],
+            stats.p50 * 1e6, stats.p99 * 1e6, stats.max * 1e6);
+        free(latencies[op]);
+        latencies[op] = NULL;
+        nlatencies[op] = latencies_capacity[op] = 0;
+    }
+    note_report("%zu rebuilds of %zu live points, mean %0.3gs, %0.3gs in all",
+        rebuilds, nlive, rebuilds > 0 ? rebuild_time / rebuilds : 0.0, rebuild_time);
+
+    GEOSSTRtree_destroy(tree);
+    tree = NULL;
+    free(xy);
+    free(state);
+    free(live);
+    free(live_pos);
+    free(absent);
+    free(pending);
+    free(pending_pos);
+    dataset_release(points);
+}
+
+/*************************************************************************
+* CONFIGURATION CALLBACK FUNCTION
+*/
+
+gp_test config_tree_churn(void)
+{
+    gp_test test = {0};
+    test.name = "STRtree churn";
+    test.description =
+        "Insert, remove and query points in an STRtree that is "
+        "rebuilt lazily from a pending list, timing each "
+        "operation and counting rebuilds.";
+    test.func_setup = setup;
+    test.func_run = run;
+    test.func_cleanup = cleanup;
+    test.params = params;
+    test.count_min = 5;
+    test.count_max = 50;
+    return test;
+}
+
+#else
+
+GEOS_PERF_SKIP(config_tree_churn);
+
+#endif
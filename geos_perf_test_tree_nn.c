@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "geos_perf.h"
 
@@ -14,17 +15,25 @@ static GEOSGeometryList points_random;
 static GEOSGeometryList points_regular;
 static GEOSSTRtree* tree;
 
+/* Parameters that can be swept with -p node_capacity=... */
+static gp_param params[] = {
+    {"node_capacity", "10", NULL},
+    {NULL, NULL, NULL}
+};
+
 
 /* Read any data we need, and create any structures */
 static void setup(void)
 {
-    size_t i;
+    size_t i, node_capacity = param_node_capacity(params);
+    if (!node_capacity)
+        return;
     geomlist_init(&points_random);
     geomlist_init(&points_regular);
     read_data_file("points_random_10000.wkt.gz", &points_random);
     read_data_file("points_regular_10000.wkt.gz", &points_regular);
     /* tree does not take ownership of inputs */
-    tree = GEOSSTRtree_create(10);
+    tree = GEOSSTRtree_create(node_capacity);
     /* populate tree with random points */
     for (i = 0; i < geomlist_size(&points_random); i++)
     {
@@ -53,13 +62,71 @@ static void cleanup(void)
     geomlist_free(&points_regular);
 }
 
+/*************************************************************************
+* THREADED VERSION
+*/
+
+/* Per-thread copy of the data and tree */
+typedef struct {
+    GEOSGeometryList points_random;
+    GEOSGeometryList points_regular;
+    GEOSSTRtree* tree;
+} thread_state;
+
+static void* thread_setup(GEOSContextHandle_t ctx)
+{
+    size_t i, node_capacity = param_node_capacity(params);
+    thread_state* state;
+    if (!node_capacity)
+        return NULL;
+    state = malloc(sizeof(thread_state));
+    geomlist_init(&state->points_random);
+    geomlist_init(&state->points_regular);
+    read_data_file_r(ctx, "points_random_10000.wkt.gz", &state->points_random);
+    read_data_file_r(ctx, "points_regular_10000.wkt.gz", &state->points_regular);
+    state->tree = GEOSSTRtree_create_r(ctx, node_capacity);
+    for (i = 0; i < geomlist_size(&state->points_random); i++)
+    {
+        const GEOSGeometry* geom = geomlist_get(&state->points_random, i);
+        GEOSSTRtree_insert_r(ctx, state->tree, geom, (void*)geom);
+    }
+    return state;
+}
+
+static void thread_run(GEOSContextHandle_t ctx, void* data)
+{
+    size_t i;
+    thread_state* state = (thread_state*)data;
+    for (i = 0; i < geomlist_size(&state->points_regular); i++)
+    {
+        const GEOSGeometry* geom = geomlist_get(&state->points_regular, i);
+        GEOSSTRtree_nearest_r(ctx, state->tree, geom);
+    }
+}
+
+static void thread_cleanup(GEOSContextHandle_t ctx, void* data)
+{
+    thread_state* state = (thread_state*)data;
+    GEOSSTRtree_destroy_r(ctx, state->tree);
+    geomlist_free_r(ctx, &state->points_random);
+    geomlist_free_r(ctx, &state->points_regular);
+    free(state);
+}
+
 /*************************************************************************
 * CONFIGURATION CALLBACK FUNCTION
 */
 
+/* Files the runner checks for before setup */
+static const char* const data_files[] = {
+    "points_random_10000.wkt.gz",
+    "points_regular_10000.wkt.gz",
+    NULL
+};
+
 gp_test config_tree_points_nn(void)
 {
-    gp_test test;
+    gp_test test = {0};
     test.name = "STRtree nearest-neighbor for points";
     test.description =
         "Load and create an STRtree for a set of points."
@@ -69,7 +136,13 @@ gp_test config_tree_points_nn(void)
     test.func_setup = setup;
     test.func_run = run;
     test.func_cleanup = cleanup;
-    test.count = 20;
+    test.func_thread_setup = thread_setup;
+    test.func_thread_run = thread_run;
+    test.func_thread_cleanup = thread_cleanup;
+    test.params = params;
+    test.count_min = 20;
+    test.count_max = 200;
+    test.data_files = data_files;
     return test;
 }
 
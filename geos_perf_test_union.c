@@ -13,9 +13,11 @@ static GEOSGeometry *collection;
 /* Read any data we need, and create any structures */
 static void setup(void)
 {
+    /* collection takes ownership of the geometries, so it */
+    /* gets clones rather than the shared dataset */
     geomlist_init(&watersheds);
-    read_data_file("watersheds.wkt.gz", &watersheds);
-    /* collection takes ownership of all geometries */
+    if (dataset_clone("watersheds.wkt.gz", &watersheds) != 0)
+        return;
     collection = GEOSGeom_createCollection(
         GEOS_GEOMETRYCOLLECTION,
         watersheds.geoms,
@@ -42,9 +44,15 @@ static void cleanup(void)
 * CONFIGURATION CALLBACK FUNCTION
 */
 
+/* Files the runner checks for before setup */
+static const char* const data_files[] = {
+    "watersheds.wkt.gz",
+    NULL
+};
+
 gp_test config_union_watersheds(void)
 {
-    gp_test test;
+    gp_test test = {0};
     test.name = "Watershed unary union";
     test.description =
         "Load a collection of watershed boundaries"
@@ -54,7 +62,9 @@ gp_test config_union_watersheds(void)
     test.func_setup = setup;
     test.func_run = run;
     test.func_cleanup = cleanup;
-    test.count = 2;
+    test.count_min = 2;
+    test.count_max = 10;
+    test.data_files = data_files;
     return test;
 }
 
@@ -0,0 +1,203 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "geos_perf.h"
+
+/************************************************************************
+* Multi-threaded throughput runner.
+*
+* Every worker gets its own reentrant GEOS context and its own
+* test state. Contexts and states are set up one at a time on the
+* main thread, so the loaders never run concurrently, then all
+* workers do their warmup and meet at a barrier. The timed section
+* runs from the barrier release until the last worker finishes.
+*
+* The workers wait at a gate until every thread has started, as
+* the barrier counts them all. If one fails to start the gate
+* sends the others home and the test is skipped.
+*/
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int state;  /* 0 waiting, 1 go, -1 abort */
+} gp_gate;
+
+typedef struct {
+    const gp_test* test;
+    GEOSContextHandle_t ctx;
+    void* state;
+    uint32_t warmup;
+    uint32_t count;
+    gp_gate* gate;
+    pthread_barrier_t* barrier;
+} gp_worker;
+
+static void
+gate_open(gp_gate* gate, int state)
+{
+    pthread_mutex_lock(&gate->lock);
+    gate->state = state;
+    pthread_cond_broadcast(&gate->cond);
+    pthread_mutex_unlock(&gate->lock);
+}
+
+static int
+gate_wait(gp_gate* gate)
+{
+    int state;
+    pthread_mutex_lock(&gate->lock);
+    while (gate->state == 0)
+        pthread_cond_wait(&gate->cond, &gate->lock);
+    state = gate->state;
+    pthread_mutex_unlock(&gate->lock);
+    return state;
+}
+
+static void
+thread_log_stderr(const char* message, void* userdata)
+{
+    debug_stderr(1, "%s\n", message);
+}
+
+static void*
+worker_main(void* arg)
+{
+    uint32_t i;
+    gp_worker* w = (gp_worker*)arg;
+
+    if (gate_wait(w->gate) < 0)
+        return NULL;
+
+    for (i = 0; i < w->warmup; i++)
+        w->test->func_thread_run(w->ctx, w->state);
+
+    pthread_barrier_wait(w->barrier);
+
+    for (i = 0; i < w->count; i++)
+        w->test->func_thread_run(w->ctx, w->state);
+
+    return NULL;
+}
+
+int
+run_throughput(const gp_test* test, uint32_t nthreads,
+               uint32_t warmup, uint32_t count,
+               double base_ops_per_sec, gp_throughput* result)
+{
+    uint32_t i, started;
+    double start, end;
+    gp_gate gate;
+    pthread_barrier_t barrier;
+    pthread_t* threads;
+    gp_worker* workers;
+
+    if (!test->func_thread_run || nthreads < 1)
+        return 0;
+
+    threads = calloc(nthreads, sizeof(pthread_t));
+    workers = calloc(nthreads, sizeof(gp_worker));
+    pthread_barrier_init(&barrier, NULL, nthreads + 1);
+    pthread_mutex_init(&gate.lock, NULL);
+    pthread_cond_init(&gate.cond, NULL);
+    gate.state = 0;
+
+    for (i = 0; i < nthreads; i++)
+    {
+        gp_worker* w = workers + i;
+        w->test = test;
+        w->ctx = GEOS_init_r();
+        GEOSContext_setNoticeMessageHandler_r(w->ctx, thread_log_stderr, NULL);
+        GEOSContext_setErrorMessageHandler_r(w->ctx, thread_log_stderr, NULL);
+        w->state = test->func_thread_setup ? test->func_thread_setup(w->ctx) : NULL;
+        w->warmup = warmup;
+        w->count = count;
+        w->gate = &gate;
+        w->barrier = &barrier;
+        if (test->func_thread_setup && !w->state)
+            break;
+    }
+
+    /* A thread setup skipped the test, undo the ones before it */
+    if (i < nthreads)
+    {
+        nthreads = i + 1;
+        for (i = 0; i < nthreads; i++)
+        {
+            gp_worker* w = workers + i;
+            if (w->state && test->func_thread_cleanup)
+                test->func_thread_cleanup(w->ctx, w->state);
+            GEOS_finish_r(w->ctx);
+        }
+        pthread_barrier_destroy(&barrier);
+        pthread_mutex_destroy(&gate.lock);
+        pthread_cond_destroy(&gate.cond);
+        free(workers);
+        free(threads);
+        return 0;
+    }
+
+    for (started = 0; started < nthreads; started++)
+    {
+        if (pthread_create(threads + started, NULL, worker_main, workers + started) != 0)
+            break;
+    }
+
+    /* A thread didn't start, send the others home and undo the setups */
+    if (started < nthreads)
+    {
+        gate_open(&gate, -1);
+        for (i = 0; i < started; i++)
+            pthread_join(threads[i], NULL);
+        for (i = 0; i < nthreads; i++)
+        {
+            gp_worker* w = workers + i;
+            if (test->func_thread_cleanup)
+                test->func_thread_cleanup(w->ctx, w->state);
+            GEOS_finish_r(w->ctx);
+        }
+        skip_report("could only start %u of %u threads", started, nthreads);
+        pthread_barrier_destroy(&barrier);
+        pthread_mutex_destroy(&gate.lock);
+        pthread_cond_destroy(&gate.cond);
+        free(workers);
+        free(threads);
+        return 0;
+    }
+
+    gate_open(&gate, 1);
+    pthread_barrier_wait(&barrier);
+    start = seconds_now();
+    for (i = 0; i < nthreads; i++)
+        pthread_join(threads[i], NULL);
+    end = seconds_now();
+
+    for (i = 0; i < nthreads; i++)
+    {
+        gp_worker* w = workers + i;
+        if (test->func_thread_cleanup)
+            test->func_thread_cleanup(w->ctx, w->state);
+        GEOS_finish_r(w->ctx);
+    }
+
+    pthread_barrier_destroy(&barrier);
+    pthread_mutex_destroy(&gate.lock);
+    pthread_cond_destroy(&gate.cond);
+    free(workers);
+    free(threads);
+
+    result->version = GEOSversion();
+    result->name = test->name;
+    result->params = NULL;
+    result->threads = nthreads;
+    result->ops = (uint64_t)nthreads * count;
+    result->wall_time = end - start;
+    result->ops_per_sec = result->wall_time > 0.0 ? result->ops / result->wall_time : 0.0;
+    if (base_ops_per_sec <= 0.0)
+        base_ops_per_sec = result->ops_per_sec;
+    result->efficiency = base_ops_per_sec > 0.0 ?
+                         result->ops_per_sec / (nthreads * base_ops_per_sec) : 0.0;
+    return 1;
+}